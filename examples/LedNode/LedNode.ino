@@ -4,6 +4,7 @@
  * Demonstrates:
  * - Watching state changes from other nodes
  * - Controlling hardware based on shared state
+ * - Partial replication: only the watched keys are stored
  *
  * Hardware:
  * - ESP32
@@ -39,6 +40,9 @@ void setup() {
     Serial.printf("LED: %s (from led state)\n", ledOn ? "ON" : "OFF");
   });
 
+  // Store only "button" and "led" (the watched keys), not the whole mesh state
+  swarm.setPartialReplica(true);
+
   Serial.println("LedNode started");
 }
 
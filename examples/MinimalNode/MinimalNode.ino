@@ -46,6 +46,13 @@
 
 #include <MeshSwarm.h>
 
+// Keys this node uses; sent as one-byte ids once every node in the mesh
+// runs the same list (see README "Key Schema")
+#define MINIMAL_KEYS(X) \
+  X(KEY_SENSOR,  "sensor",  STATE_TYPE_STRING) \
+  X(KEY_COMMAND, "command", STATE_TYPE_STRING)
+MESHSWARM_KEY_SCHEMA(MinimalKeys, MINIMAL_KEYS)
+
 MeshSwarm swarm;
 
 // Simulated sensor value
@@ -56,6 +63,7 @@ void setup() {
   // No serial output will be generated
   
   // Initialize with default network settings
+  swarm.setKeySchema(MinimalKeys);
   swarm.begin("MinimalNode");
   
   // Set initial sensor state
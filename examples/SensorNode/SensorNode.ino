@@ -45,15 +45,13 @@ void setup() {
     display.printf("Humid: %.1f %%\n", lastHumid);
   });
 
-  // Custom serial command
-  swarm.onSerialCommand([](const String& input) -> bool {
-    if (input == "dht" || input == "sensor") {
-      Serial.printf("Temperature: %.1f C\n", lastTemp);
-      Serial.printf("Humidity:    %.1f %%\n", lastHumid);
-      return true;
-    }
-    return false;
-  });
+  // Custom serial commands (listed by "help")
+  auto showSensor = [](const String& args) {
+    Serial.printf("Temperature: %.1f C\n", lastTemp);
+    Serial.printf("Humidity:    %.1f %%\n", lastHumid);
+  };
+  swarm.addSerialCommand("dht", showSensor);
+  swarm.addSerialCommand("sensor", showSensor);
 
   // Periodic sensor reading
   swarm.onLoop([]() {
@@ -0,0 +1,483 @@
+/**
+ * SimNetwork - Implementation, including the painlessMesh shim methods
+ */
+
+#include "SimNetwork.h"
+#include "SimRuntime.h"
+
+namespace sim {
+
+// ============== Frame classification ==============
+
+static int base64Value(char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+int frameType(const String& msg) {
+    const char* s = msg.c_str();
+    int type = 0;
+
+    if (s[0] == '~') {
+        // '~' + base64(MessagePack [type, data, ...]): bytes 0-1 are the
+        // fixarray header and the positive fixint type
+        int v[3];
+        for (int i = 0; i < 3; i++) {
+            v[i] = base64Value(s[1 + i]);
+            if (v[i] < 0) return 0;
+        }
+        uint8_t header = (uint8_t)((v[0] << 2) | (v[1] >> 4));
+        uint8_t first = (uint8_t)(((v[1] & 0x0F) << 4) | (v[2] >> 2));
+        if ((header & 0xF0) == 0x90 && first < 0x80) {
+            type = first;
+        }
+    } else {
+        const char* t = strstr(s, "\"t\":");
+        if (t) {
+            type = atoi(t + 4);
+        }
+    }
+    return (type > 0 && type < FRAME_TYPES) ? type : 0;
+}
+
+// ============== Membership ==============
+
+Network& Network::instance() {
+    static Network network;
+    return network;
+}
+
+int Network::attach(painlessMesh* mesh, uint32_t* nodeId) {
+    NodeScope harness(HARNESS);
+    // Real node IDs come from the MAC; random IDs keep the election honest
+    uint32_t id;
+    do {
+        id = random32();
+    } while (id == 0 || _nodes.count(id));
+
+    _nodes[id] = mesh;
+    *nodeId = id;
+    return _attached++;
+}
+
+void Network::detach(painlessMesh* mesh) {
+    NodeScope harness(HARNESS);
+    leave(mesh);
+    _nodes.erase(mesh->getNodeId());
+}
+
+void Network::join(painlessMesh* mesh) {
+    NodeScope harness(HARNESS);
+    uint32_t id = mesh->getNodeId();
+    for (uint32_t j : _joined) {
+        if (j == id) return;
+    }
+
+    if (!_joined.empty()) {
+        size_t k = _joined.size();
+        uint32_t parent;
+        switch (_config.topology) {
+            case TOPOLOGY_LINE:
+                parent = _joined.back();
+                break;
+            case TOPOLOGY_STAR:
+                parent = _joined.front();
+                break;
+            case TOPOLOGY_BALANCED:
+                parent = _joined[(k - 1) / (_config.fanout ? _config.fanout : 1)];
+                break;
+            case TOPOLOGY_TREE:
+            default:
+                parent = _joined[random32() % k];
+                break;
+        }
+        link(id, parent);
+        notify(id, MeshEvent::NEW_CONNECTION, parent);
+        notify(parent, MeshEvent::NEW_CONNECTION, id);
+    }
+
+    _joined.push_back(id);
+    topologyChanged();
+}
+
+void Network::leave(painlessMesh* mesh) {
+    NodeScope harness(HARNESS);
+    uint32_t id = mesh->getNodeId();
+    auto it = std::find(_joined.begin(), _joined.end(), id);
+    if (it == _joined.end()) return;
+    _joined.erase(it);
+
+    std::vector<uint32_t> neighbours = _links[id];
+    for (uint32_t n : neighbours) {
+        unlink(id, n);
+        notify(n, MeshEvent::DROPPED_CONNECTION, id);
+    }
+    _links.erase(id);
+
+    // Orphaned branches reconnect through the first former neighbour
+    for (size_t i = 1; i < neighbours.size(); i++) {
+        link(neighbours[i], neighbours[0]);
+        notify(neighbours[i], MeshEvent::NEW_CONNECTION, neighbours[0]);
+        notify(neighbours[0], MeshEvent::NEW_CONNECTION, neighbours[i]);
+    }
+    topologyChanged();
+}
+
+void Network::link(uint32_t a, uint32_t b) {
+    _links[a].push_back(b);
+    _links[b].push_back(a);
+}
+
+void Network::unlink(uint32_t a, uint32_t b) {
+    auto drop = [this](uint32_t from, uint32_t to) {
+        std::vector<uint32_t>& l = _links[from];
+        l.erase(std::remove(l.begin(), l.end(), to), l.end());
+    };
+    drop(a, b);
+    drop(b, a);
+}
+
+void Network::notify(uint32_t node, MeshEvent::Kind kind, uint32_t peer) {
+    auto it = _nodes.find(node);
+    if (it == _nodes.end()) return;
+    NodeScope harness(HARNESS);
+    MeshEvent ev;
+    ev.kind = kind;
+    ev.from = peer;
+    ev.delayUs = 0;
+    it->second->post(std::move(ev));
+}
+
+void Network::topologyChanged() {
+    _routes.clear();
+    for (uint32_t id : _joined) {
+        notify(id, MeshEvent::CHANGED_CONNECTIONS, 0);
+    }
+}
+
+// ============== Routing ==============
+
+const Network::Routes& Network::routes(uint32_t from) {
+    auto cached = _routes.find(from);
+    if (cached != _routes.end()) {
+        return cached->second;
+    }
+
+    NodeScope harness(HARNESS);
+    Routes& r = _routes[from];
+    r.order.push_back(from);
+    r.parent.push_back(-1);
+    r.hops.push_back(0);
+    r.index[from] = 0;
+    for (size_t i = 0; i < r.order.size(); i++) {
+        auto links = _links.find(r.order[i]);
+        if (links == _links.end()) continue;
+        for (uint32_t n : links->second) {
+            if (r.index.count(n)) continue;
+            r.index[n] = (int)r.order.size();
+            r.order.push_back(n);
+            r.parent.push_back((int)i);
+            r.hops.push_back(r.hops[i] + 1);
+        }
+    }
+    return r;
+}
+
+int Network::hops(uint32_t from, uint32_t to) {
+    const Routes& r = routes(from);
+    auto it = r.index.find(to);
+    return it == r.index.end() ? -1 : r.hops[it->second];
+}
+
+int Network::maxDepth() {
+    if (_joined.empty()) return 0;
+    const Routes& r = routes(_joined.front());
+    int depth = 0;
+    for (int h : r.hops) {
+        if (h > depth) depth = h;
+    }
+    return depth;
+}
+
+std::list<uint32_t> Network::nodeList(uint32_t self, bool includeSelf) {
+    std::list<uint32_t> out;
+    if (std::find(_joined.begin(), _joined.end(), self) == _joined.end()) {
+        return out;
+    }
+    const Routes& r = routes(self);
+    for (size_t i = includeSelf ? 0 : 1; i < r.order.size(); i++) {
+        out.push_back(r.order[i]);
+    }
+    return out;
+}
+
+painlessmesh::protocol::NodeTree Network::tree(uint32_t self) {
+    const Routes& r = routes(self);
+    std::vector<painlessmesh::protocol::NodeTree> nodes(r.order.size());
+    for (size_t i = 0; i < r.order.size(); i++) {
+        nodes[i].nodeId = r.order[i];
+    }
+    // Children always follow their parent in BFS order, so build bottom-up
+    for (size_t i = r.order.size(); i-- > 1;) {
+        nodes[r.parent[i]].subs.push_front(nodes[i]);
+    }
+    return nodes.empty() ? painlessmesh::protocol::NodeTree() : nodes[0];
+}
+
+// ============== Delivery ==============
+
+unsigned long Network::hopDelay() {
+    unsigned long jitter = _config.jitterMs ? random32() % (_config.jitterMs + 1) : 0;
+    return _config.latencyMs + jitter;
+}
+
+void Network::schedule(uint32_t from, uint32_t to, unsigned long delay, const String& msg) {
+    // TCP links keep frames between a pair of nodes in order
+    unsigned long at = nowMs + (delay ? delay : 1);
+    unsigned long& last = _lastArrival[std::make_pair(from, to)];
+    if (at < last) at = last;
+    last = at;
+
+    Delivery* d = new Delivery();
+    d->at = at;
+    d->seq = _seq++;
+    d->to = to;
+    d->from = from;
+    d->delayReply = false;
+    d->delayUs = 0;
+    d->msg = msg;
+    _queue.push(d);
+}
+
+bool Network::send(painlessMesh* sender, uint32_t dest, const String& msg) {
+    NodeScope harness(HARNESS);
+    uint32_t from = sender->getNodeId();
+    const Routes& r = routes(from);
+    if (r.order.size() < 2) {
+        return false;
+    }
+
+    int type = frameType(msg);
+    size_t len = msg.length();
+    FrameStats& s = _stats[type];
+    s.frames++;
+    s.bytes += len;
+    if (len > _maxFrame) _maxFrame = len;
+
+    if (dest != 0) {
+        auto it = r.index.find(dest);
+        if (it == r.index.end()) {
+            return false;
+        }
+        // Walk the path back to the sender, then replay it forwards
+        std::vector<int> path;
+        for (int i = it->second; i > 0; i = r.parent[i]) {
+            path.push_back(i);
+        }
+        unsigned long delay = 0;
+        for (size_t h = 0; h < path.size(); h++) {
+            s.airBytes += len;
+            if (_config.loss > 0 && randomUnit() < _config.loss) {
+                s.lost++;
+                return true;        // painlessMesh reports queued, not delivered
+            }
+            delay += hopDelay();
+        }
+        schedule(from, dest, delay, msg);
+        s.deliveries++;
+        s.deliveredBytes += len;
+        return true;
+    }
+
+    // Broadcast: flood down the BFS tree from the sender
+    std::vector<bool> reached(r.order.size(), false);
+    std::vector<unsigned long> delay(r.order.size(), 0);
+    reached[0] = true;
+    for (size_t i = 1; i < r.order.size(); i++) {
+        int p = r.parent[i];
+        if (!reached[p]) continue;
+        s.airBytes += len;
+        if (_config.loss > 0 && randomUnit() < _config.loss) {
+            s.lost++;
+            continue;
+        }
+        reached[i] = true;
+        delay[i] = delay[p] + hopDelay();
+        schedule(from, r.order[i], delay[i], msg);
+        s.deliveries++;
+        s.deliveredBytes += len;
+    }
+    return true;
+}
+
+bool Network::measureDelay(painlessMesh* sender, uint32_t dest) {
+    uint32_t from = sender->getNodeId();
+    int h = hops(from, dest);
+    if (h <= 0) {
+        return false;
+    }
+
+    NodeScope harness(HARNESS);
+    unsigned long oneWay = 0;
+    for (int i = 0; i < h; i++) {
+        oneWay += hopDelay();
+    }
+    Delivery* d = new Delivery();
+    d->at = nowMs + 2 * oneWay;
+    d->seq = _seq++;
+    d->to = from;
+    d->from = dest;
+    d->delayReply = true;
+    d->delayUs = (int32_t)(oneWay * 1000);
+    _queue.push(d);
+    return true;
+}
+
+void Network::step() {
+    NodeScope harness(HARNESS);
+    while (!_queue.empty() && _queue.top()->at <= nowMs) {
+        Delivery* d = _queue.top();
+        _queue.pop();
+
+        auto it = _nodes.find(d->to);
+        if (it != _nodes.end()) {
+            MeshEvent ev;
+            ev.kind = d->delayReply ? MeshEvent::NODE_DELAY : MeshEvent::RECEIVED;
+            ev.from = d->from;
+            ev.delayUs = d->delayUs;
+            ev.msg = std::move(d->msg);
+            it->second->post(std::move(ev));
+        }
+        delete d;
+    }
+}
+
+FrameStats Network::totals() const {
+    FrameStats t = {};
+    for (const FrameStats& s : _stats) {
+        t.frames += s.frames;
+        t.bytes += s.bytes;
+        t.deliveries += s.deliveries;
+        t.deliveredBytes += s.deliveredBytes;
+        t.airBytes += s.airBytes;
+        t.lost += s.lost;
+    }
+    return t;
+}
+
+void Network::resetStats() {
+    for (FrameStats& s : _stats) {
+        s = FrameStats();
+    }
+    _maxFrame = 0;
+}
+
+void Network::reset() {
+    NodeScope harness(HARNESS);
+    while (!_queue.empty()) {
+        delete _queue.top();
+        _queue.pop();
+    }
+    _joined.clear();
+    _links.clear();
+    _routes.clear();
+    _lastArrival.clear();
+    _attached = 0;
+    resetStats();
+}
+
+} // namespace sim
+
+// ============== painlessMesh shim ==============
+
+using sim::MeshEvent;
+using sim::Network;
+
+painlessMesh::painlessMesh() : nodeId(0), index(0) {
+    index = Network::instance().attach(this, &nodeId);
+}
+
+painlessMesh::~painlessMesh() {
+    Network::instance().detach(this);
+}
+
+void painlessMesh::init(TSTRING, TSTRING, uint16_t) {
+    Network::instance().join(this);
+}
+
+void painlessMesh::stop() {
+    Network::instance().leave(this);
+}
+
+void painlessMesh::update() {
+    // Only events queued before this call; callbacks may queue more
+    size_t pending = inbox.size();
+    while (pending-- > 0 && !inbox.empty()) {
+        MeshEvent ev;
+        {
+            sim::NodeScope harness(sim::HARNESS);
+            ev = std::move(inbox.front());
+            inbox.pop_front();
+        }
+
+        switch (ev.kind) {
+            case MeshEvent::RECEIVED:
+                if (receivedCb) receivedCb(ev.from, ev.msg);
+                break;
+            case MeshEvent::NEW_CONNECTION:
+                if (newConnectionCb) newConnectionCb(ev.from);
+                break;
+            case MeshEvent::DROPPED_CONNECTION:
+                if (droppedConnectionCb) droppedConnectionCb(ev.from);
+                break;
+            case MeshEvent::CHANGED_CONNECTIONS:
+                if (changedConnectionsCb) changedConnectionsCb();
+                break;
+            case MeshEvent::NODE_DELAY:
+                if (nodeDelayCb) nodeDelayCb(ev.from, ev.delayUs);
+                break;
+        }
+
+        // The frame buffer was allocated by the network, not this node
+        sim::NodeScope harness(sim::HARNESS);
+        MeshEvent done(std::move(ev));
+    }
+}
+
+bool painlessMesh::sendSingle(uint32_t dest, TSTRING msg) {
+    return Network::instance().send(this, dest, msg);
+}
+
+bool painlessMesh::sendBroadcast(TSTRING msg, bool includeSelf) {
+    bool sent = Network::instance().send(this, 0, msg);
+    if (includeSelf) {
+        sim::NodeScope harness(sim::HARNESS);
+        MeshEvent ev;
+        ev.kind = MeshEvent::RECEIVED;
+        ev.from = nodeId;
+        ev.delayUs = 0;
+        ev.msg = msg;
+        post(std::move(ev));
+    }
+    return sent;
+}
+
+std::list<uint32_t> painlessMesh::getNodeList(bool includeSelf) {
+    return Network::instance().nodeList(nodeId, includeSelf);
+}
+
+painlessmesh::protocol::NodeTree painlessMesh::asNodeTree() {
+    return Network::instance().tree(nodeId);
+}
+
+bool painlessMesh::isConnected(uint32_t id) {
+    return Network::instance().hops(nodeId, id) > 0;
+}
+
+bool painlessMesh::startDelayMeas(uint32_t id) {
+    return Network::instance().measureDelay(this, id);
+}
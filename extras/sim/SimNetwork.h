@@ -0,0 +1,153 @@
+/**
+ * SimNetwork - Simulated painlessMesh transport
+ *
+ * Nodes form a spanning tree, like a real painlessMesh: each joining node
+ * links to one existing node chosen by the topology. Frames travel the tree
+ * hop by hop:
+ * - Every hop adds latencyMs plus up to jitterMs (per-link FIFO order kept)
+ * - Every hop drops the frame with probability loss; a broadcast lost on
+ *   one link is missed by the whole subtree behind it
+ * - Connection events are queued to the affected nodes and dispatched by
+ *   their painlessMesh::update(), as on the device
+ *
+ * Counters are kept per MeshSwarm message type, read from the frame header
+ * (JSON "t" field or the first element of a binary frame).
+ */
+
+#ifndef SIM_NETWORK_H
+#define SIM_NETWORK_H
+
+#include <painlessMesh.h>
+#include <algorithm>
+#include <map>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+namespace sim {
+
+enum Topology {
+    TOPOLOGY_TREE,          // Parent picked at random among joined nodes
+    TOPOLOGY_LINE,          // Parent is the previously joined node
+    TOPOLOGY_STAR,          // Parent is the first node
+    TOPOLOGY_BALANCED       // Breadth-first tree with `fanout` children per node
+};
+
+struct NetConfig {
+    Topology topology = TOPOLOGY_TREE;
+    unsigned long latencyMs = 5;    // Per hop
+    unsigned long jitterMs = 2;     // Extra random delay per hop, 0..jitterMs
+    double loss = 0.0;              // Per hop drop probability
+    uint8_t fanout = 3;             // TOPOLOGY_BALANCED only
+};
+
+// Traffic counters for one message type
+struct FrameStats {
+    uint64_t frames;                // Frames handed to sendSingle/sendBroadcast
+    uint64_t bytes;                 // Payload bytes of those frames
+    uint64_t deliveries;            // Frames that reached a receiver
+    uint64_t deliveredBytes;
+    uint64_t airBytes;              // Bytes transmitted summed over every hop
+    uint64_t lost;                  // Hop transmissions dropped
+};
+
+const int FRAME_TYPES = 16;         // Indexed by MsgType, 0 = unrecognized
+
+/**
+ * Extract the MeshSwarm MsgType from a frame, 0 if unknown
+ */
+int frameType(const String& msg);
+
+class Network {
+public:
+    static Network& instance();
+
+    void configure(const NetConfig& config) { _config = config; }
+    const NetConfig& config() const { return _config; }
+
+    // ============== painlessMesh side ==============
+
+    int attach(painlessMesh* mesh, uint32_t* nodeId);
+    void detach(painlessMesh* mesh);
+    void join(painlessMesh* mesh);
+    void leave(painlessMesh* mesh);
+
+    bool send(painlessMesh* from, uint32_t dest, const String& msg);   // dest 0 = broadcast
+    bool measureDelay(painlessMesh* from, uint32_t dest);
+
+    std::list<uint32_t> nodeList(uint32_t self, bool includeSelf);
+    painlessmesh::protocol::NodeTree tree(uint32_t self);
+    int hops(uint32_t from, uint32_t to);       // -1 if unreachable
+
+    // ============== Harness side ==============
+
+    /**
+     * Hand every frame due at sim::nowMs to its receiver's inbox
+     */
+    void step();
+
+    size_t joinedCount() const { return _joined.size(); }
+    size_t inFlight() const { return _queue.size(); }
+    int maxDepth();
+
+    const FrameStats& stats(int type) const { return _stats[type]; }
+    FrameStats totals() const;
+    size_t maxFrame() const { return _maxFrame; }
+    void resetStats();
+
+    /**
+     * Forget all nodes, links and in-flight frames (between benchmark runs)
+     */
+    void reset();
+
+private:
+    Network() {}
+
+    struct Delivery {
+        unsigned long at;
+        uint64_t seq;
+        uint32_t to;
+        uint32_t from;
+        bool delayReply;
+        int32_t delayUs;
+        String msg;
+    };
+    struct Later {
+        bool operator()(const Delivery* a, const Delivery* b) const {
+            return a->at != b->at ? a->at > b->at : a->seq > b->seq;
+        }
+    };
+
+    // Breadth-first view of the tree from one node, cached until it changes
+    struct Routes {
+        std::vector<uint32_t> order;        // Reachable nodes, source first
+        std::vector<int> parent;            // Index into order, -1 for source
+        std::vector<int> hops;
+        std::unordered_map<uint32_t, int> index;
+    };
+
+    void link(uint32_t a, uint32_t b);
+    void unlink(uint32_t a, uint32_t b);
+    void notify(uint32_t node, sim::MeshEvent::Kind kind, uint32_t peer);
+    void topologyChanged();
+    const Routes& routes(uint32_t from);
+    unsigned long hopDelay();
+    void schedule(uint32_t from, uint32_t to, unsigned long delay, const String& msg);
+
+    NetConfig _config;
+    std::map<uint32_t, painlessMesh*> _nodes;                   // Attached
+    std::vector<uint32_t> _joined;                             // In join order
+    std::map<uint32_t, std::vector<uint32_t>> _links;
+    std::unordered_map<uint32_t, Routes> _routes;
+    std::map<std::pair<uint32_t, uint32_t>, unsigned long> _lastArrival;
+    std::priority_queue<Delivery*, std::vector<Delivery*>, Later> _queue;
+    uint64_t _seq = 0;
+    int _attached = 0;
+
+    FrameStats _stats[FRAME_TYPES] = {};
+    size_t _maxFrame = 0;
+};
+
+} // namespace sim
+
+#endif // SIM_NETWORK_H
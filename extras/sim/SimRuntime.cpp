@@ -0,0 +1,186 @@
+/**
+ * SimRuntime - Implementation
+ *
+ * Also provides the globals declared by the Arduino shim (Serial, ESP).
+ */
+
+#include "SimRuntime.h"
+#include <Arduino.h>
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+#define SIM_TRACK_ALLOCS 1
+#include <malloc.h>
+#else
+#define SIM_TRACK_ALLOCS 0
+#endif
+
+namespace sim {
+
+unsigned long nowMs = 0;
+
+// ============== Clock and RNG ==============
+
+static uint64_t rngState = 0x9E3779B97F4A7C15ULL;
+static bool serialEcho = false;
+
+void seed(uint32_t value) {
+    rngState = 0x9E3779B97F4A7C15ULL ^ ((uint64_t)value << 17) ^ value;
+}
+
+// splitmix64: fast, deterministic for a given seed on every host
+uint32_t random32() {
+    uint64_t z = (rngState += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return (uint32_t)((z ^ (z >> 31)) >> 16);
+}
+
+double randomUnit() {
+    return random32() / 4294967296.0;
+}
+
+void setSerialEcho(bool enable) {
+    serialEcho = enable;
+}
+
+// ============== Allocation accounting ==============
+
+static AllocStats allocTable[SIM_MAX_NODES + 1];
+static int runningNode = HARNESS;
+
+static inline AllocStats& slot(int node) {
+    return (node >= 0 && node < SIM_MAX_NODES) ? allocTable[node + 1] : allocTable[0];
+}
+
+bool allocTrackingAvailable() {
+    return SIM_TRACK_ALLOCS;
+}
+
+const AllocStats& allocStats(int node) {
+    return slot(node);
+}
+
+void resetAllocStats() {
+    for (AllocStats& s : allocTable) {
+        s.allocs = 0;
+        s.frees = 0;
+        s.allocBytes = 0;
+        s.peak = s.live;
+    }
+}
+
+int currentNode() {
+    return runningNode;
+}
+
+NodeScope::NodeScope(int node) : _previous(runningNode) {
+    runningNode = node;
+}
+
+NodeScope::~NodeScope() {
+    runningNode = _previous;
+}
+
+#if SIM_TRACK_ALLOCS
+static inline void charge(void* p, size_t requested) {
+    AllocStats& s = slot(runningNode);
+    s.allocs++;
+    s.allocBytes += requested;
+    s.live += malloc_usable_size(p);
+    if (s.live > s.peak) {
+        s.peak = s.live;
+    }
+}
+
+static inline void release(void* p) {
+    AllocStats& s = slot(runningNode);
+    s.frees++;
+    s.live -= malloc_usable_size(p);
+}
+#endif
+
+} // namespace sim
+
+// ============== malloc wrappers (glibc) ==============
+// operator new, std::string (String) and ArduinoJson all land here
+
+#if SIM_TRACK_ALLOCS
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+
+void* malloc(size_t size) {
+    void* p = __libc_malloc(size);
+    if (p) sim::charge(p, size);
+    return p;
+}
+
+void* calloc(size_t count, size_t size) {
+    void* p = __libc_calloc(count, size);
+    if (p) sim::charge(p, count * size);
+    return p;
+}
+
+void* realloc(void* ptr, size_t size) {
+    if (ptr) sim::release(ptr);
+    void* p = __libc_realloc(ptr, size);
+    if (p) {
+        sim::charge(p, size);
+    } else if (ptr && size > 0) {
+        sim::charge(ptr, 0);        // Failed realloc keeps the old block
+    }
+    return p;
+}
+
+void free(void* ptr) {
+    if (!ptr) return;
+    sim::release(ptr);
+    __libc_free(ptr);
+}
+}
+#endif
+
+// ============== Arduino shim globals ==============
+
+HardwareSerial Serial;
+EspClass ESP;
+
+size_t HardwareSerial::write(uint8_t c) {
+    static bool lineStart = true;
+    if (!sim::serialEcho) {
+        return 1;
+    }
+    if (lineStart) {
+        int node = sim::currentNode();
+        if (node == sim::HARNESS) {
+            fprintf(stdout, "[%6lu.%03lu sim] ", sim::nowMs / 1000, sim::nowMs % 1000);
+        } else {
+            fprintf(stdout, "[%6lu.%03lu n%-3d] ", sim::nowMs / 1000, sim::nowMs % 1000, node);
+        }
+    }
+    fputc(c, stdout);
+    lineStart = (c == '\n');
+    return 1;
+}
+
+uint32_t EspClass::getFreeHeap() {
+    int64_t live = sim::allocStats(sim::currentNode()).live;
+    if (live < 0) live = 0;
+    return live >= SIM_HEAP_BYTES ? 0 : (uint32_t)(SIM_HEAP_BYTES - live);
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+    int64_t peak = sim::allocStats(sim::currentNode()).peak;
+    if (peak < 0) peak = 0;
+    return peak >= SIM_HEAP_BYTES ? 0 : (uint32_t)(SIM_HEAP_BYTES - peak);
+}
+
+uint32_t EspClass::getHeapSize() {
+    return SIM_HEAP_BYTES;
+}
+
+uint64_t EspClass::getEfuseMac() {
+    return 0x24A1600000ULL + (uint32_t)(sim::currentNode() + 1);
+}
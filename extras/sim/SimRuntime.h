@@ -0,0 +1,75 @@
+/**
+ * SimRuntime - Virtual clock, RNG and allocation accounting for the host simulator
+ *
+ * All simulated nodes share one process and one thread. The harness marks
+ * which node is running with NodeScope, and every heap allocation made in
+ * that scope is charged to the node. ESP.getFreeHeap() in the Arduino shim
+ * reports SIM_HEAP_BYTES minus the running node's live bytes.
+ *
+ * Allocation accounting wraps malloc/calloc/realloc/free and needs glibc;
+ * elsewhere allocTrackingAvailable() is false and the counters stay zero.
+ */
+
+#ifndef SIM_RUNTIME_H
+#define SIM_RUNTIME_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef SIM_HEAP_BYTES
+#define SIM_HEAP_BYTES 240000     // Free heap of an idle ESP32 with WiFi and mesh up
+#endif
+
+#ifndef SIM_MAX_NODES
+#define SIM_MAX_NODES  1024
+#endif
+
+namespace sim {
+
+// ============== Clock and RNG ==============
+
+extern unsigned long nowMs;
+
+void seed(uint32_t value);
+uint32_t random32();
+double randomUnit();            // Uniform in [0, 1)
+
+// ============== Serial ==============
+
+void setSerialEcho(bool enable);
+
+// ============== Allocation accounting ==============
+
+struct AllocStats {
+    uint64_t allocs;            // malloc/calloc/realloc calls that returned memory
+    uint64_t frees;
+    uint64_t allocBytes;        // Bytes requested, cumulative
+    int64_t live;               // Bytes currently held (usable size)
+    int64_t peak;               // Highest live since the last resetAllocStats()
+};
+
+const int HARNESS = -1;         // Owner of allocations made outside any node
+
+bool allocTrackingAvailable();
+const AllocStats& allocStats(int node);
+void resetAllocStats();         // Clears counters and peaks, keeps live bytes
+int currentNode();
+
+/**
+ * Charges allocations in the enclosing scope to one node
+ */
+class NodeScope {
+public:
+    explicit NodeScope(int node);
+    ~NodeScope();
+
+    NodeScope(const NodeScope&) = delete;
+    NodeScope& operator=(const NodeScope&) = delete;
+
+private:
+    int _previous;
+};
+
+} // namespace sim
+
+#endif // SIM_RUNTIME_H
@@ -0,0 +1,562 @@
+/**
+ * MeshSwarm Host Simulator - Benchmark runner
+ *
+ * Runs N MeshSwarm nodes in one process on a simulated painlessMesh and
+ * times a fixed sequence of scenarios:
+ *
+ *   formation   every node sees every other node alive, one coordinator
+ *   single      one key written on a random node reaches all nodes
+ *   burst       K keys written on one node reach all nodes
+ *   conflict    several nodes write one key at once; all agree on a value
+ *   late join   a new node receives the existing state
+ *   idle        steady-state background traffic
+ *   chatty      one node writes more keys than a store holds; repair
+ *               traffic stops once the writes do (digest sync builds only)
+ *   late caps   another node joins over 5% loss after heartbeats have
+ *               stretched; every node is back to the same capabilities
+ *
+ * Usage: meshswarm-sim [options]   (see --help)
+ */
+
+#include <MeshSwarm.h>
+#include "SimNetwork.h"
+#include "SimRuntime.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+using sim::Network;
+using sim::NodeScope;
+
+// ============== Options ==============
+
+struct Options {
+    std::vector<int> nodeCounts = {10};
+    sim::NetConfig net;
+    int burstKeys = 50;
+    int conflictWriters = 5;
+    int chattyKeys = STATE_MAX_ENTRIES + 64;
+    unsigned long joinSpacingMs = 20;
+    unsigned long tickMs = 1;
+    unsigned long timeoutMs = 120000;
+    unsigned long idleMs = 30000;
+    uint32_t seed = 1;
+    bool csv = false;
+    bool verbose = false;
+};
+
+static void usage() {
+    printf("Usage: meshswarm-sim [options]\n"
+           "  --nodes N[,N...]   Node counts to run (default 10)\n"
+           "  --suite            Same as --nodes 10,50,200\n"
+           "  --topology T       tree | line | star | balanced (default tree)\n"
+           "  --fanout N         Children per node for balanced (default 3)\n"
+           "  --latency MS       Per hop latency (default 5)\n"
+           "  --jitter MS        Extra per hop delay, 0..MS (default 2)\n"
+           "  --loss PCT         Per hop frame loss in percent (default 0)\n"
+           "  --keys N           Keys in the burst scenario (default 50)\n"
+           "  --writers N        Nodes in the conflict scenario (default 5)\n"
+           "  --chatty N         Keys in the chatty scenario (default %d)\n"
+           "  --join MS          Delay between node joins (default 20)\n"
+           "  --tick MS          Simulation step (default 1)\n"
+           "  --timeout S        Per scenario limit in seconds (default 120)\n"
+           "  --idle S           Idle traffic window in seconds (default 30)\n"
+           "  --seed N           RNG seed (default 1)\n"
+           "  --csv              One CSV line per run instead of tables\n"
+           "  --verbose          Echo node serial output\n", STATE_MAX_ENTRIES + 64);
+}
+
+static bool parseOptions(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        auto next = [&](const char* name) -> const char* {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "%s needs a value\n", name);
+                exit(2);
+            }
+            return argv[++i];
+        };
+
+        if (a == "--nodes") {
+            opt.nodeCounts.clear();
+            std::string list = next("--nodes");
+            size_t pos = 0;
+            while (pos < list.size()) {
+                size_t comma = list.find(',', pos);
+                if (comma == std::string::npos) comma = list.size();
+                int n = atoi(list.substr(pos, comma - pos).c_str());
+                if (n > 0) opt.nodeCounts.push_back(n);
+                pos = comma + 1;
+            }
+        } else if (a == "--suite") {
+            opt.nodeCounts = {10, 50, 200};
+        } else if (a == "--topology") {
+            std::string t = next("--topology");
+            if (t == "tree") opt.net.topology = sim::TOPOLOGY_TREE;
+            else if (t == "line") opt.net.topology = sim::TOPOLOGY_LINE;
+            else if (t == "star") opt.net.topology = sim::TOPOLOGY_STAR;
+            else if (t == "balanced") opt.net.topology = sim::TOPOLOGY_BALANCED;
+            else {
+                fprintf(stderr, "Unknown topology: %s\n", t.c_str());
+                return false;
+            }
+        } else if (a == "--fanout") {
+            opt.net.fanout = (uint8_t)atoi(next("--fanout"));
+        } else if (a == "--latency") {
+            opt.net.latencyMs = strtoul(next("--latency"), nullptr, 10);
+        } else if (a == "--jitter") {
+            opt.net.jitterMs = strtoul(next("--jitter"), nullptr, 10);
+        } else if (a == "--loss") {
+            opt.net.loss = atof(next("--loss")) / 100.0;
+        } else if (a == "--keys") {
+            opt.burstKeys = atoi(next("--keys"));
+        } else if (a == "--writers") {
+            opt.conflictWriters = atoi(next("--writers"));
+        } else if (a == "--chatty") {
+            opt.chattyKeys = atoi(next("--chatty"));
+        } else if (a == "--join") {
+            opt.joinSpacingMs = strtoul(next("--join"), nullptr, 10);
+        } else if (a == "--tick") {
+            opt.tickMs = strtoul(next("--tick"), nullptr, 10);
+            if (opt.tickMs == 0) opt.tickMs = 1;
+        } else if (a == "--timeout") {
+            opt.timeoutMs = strtoul(next("--timeout"), nullptr, 10) * 1000;
+        } else if (a == "--idle") {
+            opt.idleMs = strtoul(next("--idle"), nullptr, 10) * 1000;
+        } else if (a == "--seed") {
+            opt.seed = strtoul(next("--seed"), nullptr, 10);
+        } else if (a == "--csv") {
+            opt.csv = true;
+        } else if (a == "--verbose") {
+            opt.verbose = true;
+        } else {
+            usage();
+            return false;
+        }
+    }
+    return !opt.nodeCounts.empty();
+}
+
+static const char* typeName(int type) {
+    switch (type) {
+        case MSG_HEARTBEAT:    return "heartbeat";
+        case MSG_STATE_SET:    return "state_set";
+        case MSG_STATE_SYNC:   return "state_sync";
+        case MSG_STATE_REQ:    return "state_req";
+        case MSG_COMMAND:      return "command";
+        case MSG_TELEMETRY:    return "telemetry";
+        case MSG_STATE_DIGEST: return "state_digest";
+        case MSG_SYNC_CLAIM:   return "sync_claim";
+        default:               return nullptr;
+    }
+}
+
+// ============== Simulation ==============
+
+struct Scenario {
+    const char* name;
+    long ms;                    // Time to converge, -1 on timeout
+    sim::FrameStats traffic;    // All message types during the scenario
+};
+
+class Simulation {
+public:
+    explicit Simulation(const Options& opt) : _opt(opt) {}
+
+    ~Simulation() {
+        for (size_t i = 0; i < _nodes.size(); i++) {
+            NodeScope scope((int)i);
+            _nodes[i].reset();
+        }
+        Network::instance().reset();
+    }
+
+    void addNode() {
+        int index = (int)_nodes.size();
+        NodeScope scope(index);
+        _nodes.emplace_back(new MeshSwarm());
+        String name = "node" + String(index);
+        _nodes.back()->begin(name.c_str());
+    }
+
+    void tick() {
+        sim::nowMs += _opt.tickMs;
+        Network::instance().step();
+        for (size_t i = 0; i < _nodes.size(); i++) {
+            NodeScope scope((int)i);
+            _nodes[i]->update();
+        }
+    }
+
+    void run(unsigned long ms) {
+        unsigned long end = sim::nowMs + ms;
+        while ((long)(sim::nowMs - end) < 0) {
+            tick();
+        }
+    }
+
+    // Ticks until done() holds; returns elapsed ms or -1 after the timeout
+    template <typename Pred>
+    long runUntil(Pred done) {
+        unsigned long start = sim::nowMs;
+        while (!done()) {
+            if (sim::nowMs - start >= _opt.timeoutMs) {
+                return -1;
+            }
+            tick();
+        }
+        return (long)(sim::nowMs - start);
+    }
+
+    template <typename Body, typename Pred>
+    Scenario measure(const char* name, Body body, Pred done) {
+        sim::FrameStats before = Network::instance().totals();
+        body();
+        Scenario s;
+        s.name = name;
+        s.ms = runUntil(done);
+        s.traffic = delta(before, Network::instance().totals());
+        return s;
+    }
+
+    static sim::FrameStats delta(const sim::FrameStats& a, const sim::FrameStats& b) {
+        sim::FrameStats d;
+        d.frames = b.frames - a.frames;
+        d.bytes = b.bytes - a.bytes;
+        d.deliveries = b.deliveries - a.deliveries;
+        d.deliveredBytes = b.deliveredBytes - a.deliveredBytes;
+        d.airBytes = b.airBytes - a.airBytes;
+        d.lost = b.lost - a.lost;
+        return d;
+    }
+
+    bool allHave(const String& key, const String& value, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            if (_nodes[i]->getState(key) != value) return false;
+        }
+        return true;
+    }
+
+    MeshSwarm& node(size_t i) { return *_nodes[i]; }
+    size_t size() const { return _nodes.size(); }
+
+private:
+    const Options& _opt;
+    std::vector<std::unique_ptr<MeshSwarm>> _nodes;
+};
+
+// ============== Benchmark ==============
+
+struct RunResult {
+    int nodes;
+    int depth;
+    std::vector<Scenario> scenarios;
+    double idleAirBytesPerNodeSec;
+    sim::FrameStats types[sim::FRAME_TYPES];
+    size_t maxFrame;
+    uint64_t nodeAllocs;
+    double allocsPerNodeSec;
+    int64_t peakMax;
+    int64_t peakMean;
+    double simSeconds;
+    double hostSeconds;
+};
+
+static RunResult runBenchmark(const Options& opt, int n) {
+    RunResult res = RunResult();
+    res.nodes = n;
+
+    sim::seed(opt.seed);
+    sim::nowMs = 0;
+    Network& net = Network::instance();
+    net.configure(opt.net);
+    net.resetStats();
+    sim::resetAllocStats();
+    auto hostStart = std::chrono::steady_clock::now();
+
+    Simulation s(opt);
+
+    // Formation: nodes join one by one, then wait for full peer tables
+    Scenario formation;
+    formation.name = "formation";
+    sim::FrameStats before = net.totals();
+    unsigned long joinStart = sim::nowMs;
+    for (int i = 0; i < n; i++) {
+        s.addNode();
+        s.run(opt.joinSpacingMs);
+    }
+    unsigned long joinMs = sim::nowMs - joinStart;
+    formation.ms = s.runUntil([&]() {
+        int coordinators = 0;
+        for (int i = 0; i < n; i++) {
+            if (s.node(i).getPeerCount() != n - 1) return false;
+            coordinators += s.node(i).isCoordinator();
+        }
+        return coordinators == 1;
+    });
+    if (formation.ms >= 0) {
+        formation.ms += (long)joinMs;    // Measured from the first join
+    }
+    formation.traffic = Simulation::delta(before, net.totals());
+    res.scenarios.push_back(formation);
+    res.depth = net.maxDepth();
+    s.run(1000);
+
+    // Single write from a random node
+    String singleValue = "v" + String((long)sim::random32());
+    int writer = (int)(sim::random32() % n);
+    res.scenarios.push_back(s.measure("single",
+        [&]() { NodeScope scope(writer); s.node(writer).setState("bench/single", singleValue); },
+        [&]() { return s.allHave("bench/single", singleValue, n); }));
+    s.run(1000);
+
+    // Burst of keys from one node
+    writer = (int)(sim::random32() % n);
+    std::vector<int> progress(n, 0);
+    res.scenarios.push_back(s.measure("burst",
+        [&]() {
+            NodeScope scope(writer);
+            for (int k = 0; k < opt.burstKeys; k++) {
+                s.node(writer).setState("bench/burst/" + String(k), String(k * 7));
+            }
+        },
+        [&]() {
+            for (int i = 0; i < n; i++) {
+                while (progress[i] < opt.burstKeys &&
+                       s.node(i).getState("bench/burst/" + String(progress[i])) == String(progress[i] * 7)) {
+                    progress[i]++;
+                }
+                if (progress[i] < opt.burstKeys) return false;
+            }
+            return true;
+        }));
+    s.run(1000);
+
+    // Concurrent writes to one key
+    int writers = opt.conflictWriters < n ? opt.conflictWriters : n;
+    res.scenarios.push_back(s.measure("conflict",
+        [&]() {
+            for (int w = 0; w < writers; w++) {
+                int i = (int)((uint64_t)w * n / writers);
+                NodeScope scope(i);
+                s.node(i).setState("bench/conflict", "w" + String(i));
+            }
+        },
+        [&]() {
+            String first = s.node(0).getState("bench/conflict");
+            return first.length() > 0 && s.allHave("bench/conflict", first, n);
+        }));
+    s.run(1000);
+
+    // Late joiner catches up with everything written so far
+    String conflictValue = s.node(0).getState("bench/conflict");
+    res.scenarios.push_back(s.measure("late_join",
+        [&]() { s.addNode(); },
+        [&]() {
+            MeshSwarm& late = s.node(n);
+            if (late.getState("bench/single") != singleValue) return false;
+            if (late.getState("bench/conflict") != conflictValue) return false;
+            for (int k = 0; k < opt.burstKeys; k++) {
+                if (late.getState("bench/burst/" + String(k)) != String(k * 7)) return false;
+            }
+            return true;
+        }));
+
+    // One node asks for a resync; measures the reply traffic
+    int requester = (int)(sim::random32() % s.size());
+    unsigned long resyncEnd = 0;
+    res.scenarios.push_back(s.measure("resync",
+        [&]() {
+            NodeScope scope(requester);
+            s.node(requester).requestStateSync();
+            resyncEnd = sim::nowMs + 2000;
+        },
+        [&]() { return (long)(sim::nowMs - resyncEnd) >= 0; }));
+
+    // Steady-state background traffic
+    before = net.totals();
+    s.run(opt.idleMs);
+    Scenario idle;
+    idle.name = "idle";
+    idle.ms = (long)opt.idleMs;
+    idle.traffic = Simulation::delta(before, net.totals());
+    res.scenarios.push_back(idle);
+    res.idleAirBytesPerNodeSec = opt.idleMs
+        ? idle.traffic.airBytes * 1000.0 / opt.idleMs / s.size() : 0;
+
+#if MESHSWARM_ENABLE_DIGEST_SYNC
+    // One node keeps writing new keys, more than the other stores hold, so
+    // they evict. Timed from the last write to the last state sync frame,
+    // once none was sent for three digest rounds. Skipped without digest
+    // sync: periodic full syncs never go quiet.
+    writer = (int)(sim::random32() % s.size());
+    unsigned long quietSince = 0;
+    uint64_t syncFrames = 0;
+    res.scenarios.push_back(s.measure("chatty",
+        [&]() {
+            for (int k = 0; k < opt.chattyKeys; k++) {
+                {
+                    NodeScope scope(writer);
+                    s.node(writer).setState("bench/chatty/" + String(k), String(k));
+                }
+                s.run(50);
+            }
+            quietSince = sim::nowMs;
+            syncFrames = net.stats(MSG_STATE_SYNC).frames;
+        },
+        [&]() {
+            if (net.stats(MSG_STATE_SYNC).frames != syncFrames) {
+                syncFrames = net.stats(MSG_STATE_SYNC).frames;
+                quietSince = sim::nowMs;
+            }
+            return sim::nowMs - quietSince >= 3 * STATE_SYNC_INTERVAL;
+        }));
+    if (res.scenarios.back().ms >= 0) {
+        res.scenarios.back().ms -= 3 * STATE_SYNC_INTERVAL;
+    }
+#endif
+
+    // A second late joiner on lossy links, once heartbeats have stretched:
+    // every node must get back to the capabilities the mesh had before
+    uint8_t caps = s.node(0).getMeshCapabilities();
+    sim::NetConfig lossy = opt.net;
+    lossy.loss = opt.net.loss > 0.05 ? opt.net.loss : 0.05;
+    res.scenarios.push_back(s.measure("late_caps",
+        [&]() {
+            net.configure(lossy);
+            s.addNode();
+        },
+        [&]() {
+            for (size_t i = 0; i < s.size(); i++) {
+                if (s.node(i).getMeshCapabilities() != caps) return false;
+            }
+            return true;
+        }));
+    net.configure(opt.net);
+
+    for (int t = 0; t < sim::FRAME_TYPES; t++) {
+        res.types[t] = net.stats(t);
+    }
+    res.maxFrame = net.maxFrame();
+
+    res.simSeconds = sim::nowMs / 1000.0;
+    int64_t peakSum = 0;
+    for (size_t i = 0; i < s.size(); i++) {
+        const sim::AllocStats& a = sim::allocStats((int)i);
+        res.nodeAllocs += a.allocs;
+        peakSum += a.peak;
+        if (a.peak > res.peakMax) res.peakMax = a.peak;
+    }
+    res.peakMean = s.size() ? peakSum / (int64_t)s.size() : 0;
+    res.allocsPerNodeSec = res.simSeconds > 0 ? res.nodeAllocs / res.simSeconds / s.size() : 0;
+    res.hostSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - hostStart).count();
+    return res;
+}
+
+// ============== Report ==============
+
+static const char* topologyName(sim::Topology t) {
+    switch (t) {
+        case sim::TOPOLOGY_LINE:     return "line";
+        case sim::TOPOLOGY_STAR:     return "star";
+        case sim::TOPOLOGY_BALANCED: return "balanced";
+        default:                     return "tree";
+    }
+}
+
+static void printReport(const Options& opt, const RunResult& r) {
+    printf("\n=== %d nodes, %s topology (depth %d), %lu+0..%lu ms/hop, %.1f%% loss, seed %u ===\n",
+           r.nodes, topologyName(opt.net.topology), r.depth, opt.net.latencyMs, opt.net.jitterMs,
+           opt.net.loss * 100.0, opt.seed);
+
+    printf("%-12s %10s %10s %12s %12s\n", "scenario", "time ms", "frames", "bytes", "air bytes");
+    for (const Scenario& s : r.scenarios) {
+        char ms[16];
+        if (s.ms < 0) snprintf(ms, sizeof(ms), "TIMEOUT");
+        else snprintf(ms, sizeof(ms), "%ld", s.ms);
+        printf("%-12s %10s %10llu %12llu %12llu\n", s.name, ms,
+               (unsigned long long)s.traffic.frames, (unsigned long long)s.traffic.bytes,
+               (unsigned long long)s.traffic.airBytes);
+    }
+    printf("idle air traffic: %.0f B/s per node\n", r.idleAirBytesPerNodeSec);
+
+    printf("\n%-13s %10s %12s %12s %12s %9s\n", "message", "frames", "deliveries", "bytes",
+           "air bytes", "avg size");
+    for (int t = 0; t < sim::FRAME_TYPES; t++) {
+        const sim::FrameStats& f = r.types[t];
+        if (f.frames == 0) continue;
+        char label[16];
+        const char* name = typeName(t);
+        if (name) snprintf(label, sizeof(label), "%s", name);
+        else snprintf(label, sizeof(label), "type %d", t);
+        printf("%-13s %10llu %12llu %12llu %12llu %9llu\n", label,
+               (unsigned long long)f.frames, (unsigned long long)f.deliveries,
+               (unsigned long long)f.bytes, (unsigned long long)f.airBytes,
+               (unsigned long long)(f.bytes / f.frames));
+    }
+    printf("largest frame: %zu bytes\n", r.maxFrame);
+
+    if (sim::allocTrackingAvailable()) {
+        printf("\nallocations: %llu on nodes (%.1f per node per second)\n",
+               (unsigned long long)r.nodeAllocs, r.allocsPerNodeSec);
+        printf("peak heap per node: %lld B mean, %lld B max (min free %lld of %d B)\n",
+               (long long)r.peakMean, (long long)r.peakMax,
+               (long long)(SIM_HEAP_BYTES - r.peakMax), SIM_HEAP_BYTES);
+    } else {
+        printf("\nallocations: not tracked on this host (needs glibc, no ASAN)\n");
+    }
+    printf("simulated %.1f s in %.2f s host time\n", r.simSeconds, r.hostSeconds);
+}
+
+static void printCsvHeader(const RunResult& r) {
+    printf("nodes,depth");
+    for (const Scenario& s : r.scenarios) {
+        printf(",%s_ms,%s_air_bytes", s.name, s.name);
+    }
+    printf(",idle_Bps_per_node,frames,air_bytes,max_frame,allocs_per_node_s,peak_heap_max,host_s\n");
+}
+
+static void printCsv(const RunResult& r) {
+    sim::FrameStats total = {};
+    for (int t = 0; t < sim::FRAME_TYPES; t++) {
+        total.frames += r.types[t].frames;
+        total.airBytes += r.types[t].airBytes;
+    }
+    printf("%d,%d", r.nodes, r.depth);
+    for (const Scenario& s : r.scenarios) {
+        printf(",%ld,%llu", s.ms, (unsigned long long)s.traffic.airBytes);
+    }
+    printf(",%.0f,%llu,%llu,%zu,%.1f,%lld,%.2f\n", r.idleAirBytesPerNodeSec,
+           (unsigned long long)total.frames, (unsigned long long)total.airBytes, r.maxFrame,
+           r.allocsPerNodeSec, (long long)r.peakMax, r.hostSeconds);
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseOptions(argc, argv, opt)) {
+        return 2;
+    }
+    sim::setSerialEcho(opt.verbose);
+
+    bool failed = false;
+    bool header = false;
+    for (int n : opt.nodeCounts) {
+        RunResult r = runBenchmark(opt, n);
+        if (opt.csv) {
+            if (!header) {
+                printCsvHeader(r);
+                header = true;
+            }
+            printCsv(r);
+        } else {
+            printReport(opt, r);
+        }
+        for (const Scenario& s : r.scenarios) {
+            failed |= s.ms < 0;
+        }
+        fflush(stdout);
+    }
+    return failed ? 1 : 0;
+}
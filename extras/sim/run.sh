@@ -0,0 +1,55 @@
+#!/bin/bash
+# ============================================================
+# MeshSwarm host simulator - build and run without PlatformIO
+# ============================================================
+# Usage: extras/sim/run.sh [simulator options]
+#   extras/sim/run.sh --suite
+#   extras/sim/run.sh --nodes 50 --loss 1 --topology line
+#
+# Needs g++ (C++17) and ArduinoJson 7. The ArduinoJson source directory is
+# taken from $ARDUINOJSON, the PlatformIO native env's libdeps, or the
+# Arduino IDE libraries folder. Extra compiler flags (e.g. feature flags)
+# can be passed in $SIM_FLAGS.
+
+set -e
+
+SIM_DIR="$(cd "$(dirname "$0")" && pwd)"
+ROOT="$(cd "$SIM_DIR/../.." && pwd)"
+OUT="$SIM_DIR/.build"
+
+if [ -z "$ARDUINOJSON" ]; then
+    for dir in "$SIM_DIR/.pio/libdeps/native/ArduinoJson/src" \
+               "$HOME/Arduino/libraries/ArduinoJson/src" \
+               "$HOME/Documents/Arduino/libraries/ArduinoJson/src"; do
+        if [ -f "$dir/ArduinoJson.h" ]; then
+            ARDUINOJSON="$dir"
+            break
+        fi
+    done
+fi
+if [ -z "$ARDUINOJSON" ] || [ ! -f "$ARDUINOJSON/ArduinoJson.h" ]; then
+    echo "ArduinoJson 7 not found; set ARDUINOJSON=<dir containing ArduinoJson.h>" >&2
+    exit 2
+fi
+
+# Same feature set as the PlatformIO native env (see platformio.ini)
+FLAGS="-std=gnu++17 -O2 -g -Wall -Wno-format -Wno-unused-function
+       -DMESHSWARM_ENABLE_DISPLAY=0
+       -DMESHSWARM_ENABLE_TELEMETRY=0
+       -DMESHSWARM_ENABLE_OTA=0
+       -DMESHSWARM_ENABLE_STATE_SNAPSHOT=0
+       -DMESHSWARM_LOG_LEVEL=MESHSWARM_LOG_INFO
+       $SIM_FLAGS"
+
+mkdir -p "$OUT"
+rm -f "$OUT/meshswarm-sim"
+
+# The build-configuration #pragma message notes are filtered out
+g++ $FLAGS -I"$SIM_DIR/shim" -I"$SIM_DIR" -I"$ROOT/src" -isystem "$ARDUINOJSON" \
+    "$ROOT/src/MeshSwarm.cpp" "$ROOT/src/StateStore.cpp" "$ROOT/src/MsgArena.cpp" \
+    "$SIM_DIR/SimNetwork.cpp" "$SIM_DIR/SimRuntime.cpp" "$SIM_DIR/main.cpp" \
+    -o "$OUT/meshswarm-sim" 2>&1 |
+    grep -v -e "pragma message" -e "^In file included" -e "^ *from " -e "^ *[0-9]* |" -e "^ *|" >&2 || true
+
+[ -x "$OUT/meshswarm-sim" ] || exit 1
+exec "$OUT/meshswarm-sim" "$@"
@@ -0,0 +1,256 @@
+/*
+ * MeshSwarm Host Simulator - Arduino core shim
+ *
+ * Just enough of the Arduino/ESP32 core for MeshSwarm.cpp to compile and
+ * run on a desktop host. Time is virtual and advanced by the simulator;
+ * ESP heap figures are derived from the allocations of the running node.
+ */
+
+#ifndef MESHSWARM_SIM_ARDUINO_H
+#define MESHSWARM_SIM_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <ctype.h>
+#include <string>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+#define HEX 16
+#define DEC 10
+
+#define HIGH 1
+#define LOW  0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+// ============== VIRTUAL CLOCK ==============
+namespace sim {
+  extern unsigned long nowMs;
+  uint32_t random32();
+}
+
+inline unsigned long millis() { return sim::nowMs; }
+inline unsigned long micros() { return sim::nowMs * 1000UL; }
+inline void delay(unsigned long) {}
+inline void delayMicroseconds(unsigned int) {}
+inline void yield() {}
+
+inline long random(long maxVal) { return maxVal > 0 ? (long)(sim::random32() % (uint32_t)maxVal) : 0; }
+inline long random(long minVal, long maxVal) {
+  return maxVal > minVal ? minVal + (long)(sim::random32() % (uint32_t)(maxVal - minVal)) : minVal;
+}
+inline void randomSeed(unsigned long) {}
+inline uint32_t esp_random() { return sim::random32(); }
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+inline int digitalRead(uint8_t) { return LOW; }
+
+// ============== STRING ==============
+class String {
+public:
+  String() {}
+  String(const char* s) : s_(s ? s : "") {}
+  String(const char* s, size_t n) : s_(s, n) {}
+  String(const std::string& s) : s_(s) {}
+  String(char c) : s_(1, c) {}
+  String(int v, unsigned char base = DEC) { fromLong(v, base); }
+  String(unsigned int v, unsigned char base = DEC) { fromULong(v, base); }
+  String(long v, unsigned char base = DEC) { fromLong(v, base); }
+  String(unsigned long v, unsigned char base = DEC) { fromULong(v, base); }
+  String(float v, unsigned int decimals = 2) { fromDouble(v, decimals); }
+  String(double v, unsigned int decimals = 2) { fromDouble(v, decimals); }
+
+  const char* c_str() const { return s_.c_str(); }
+  unsigned int length() const { return s_.size(); }
+  bool isEmpty() const { return s_.empty(); }
+  bool reserve(unsigned int n) { s_.reserve(n); return true; }
+  char charAt(unsigned int i) const { return i < s_.size() ? s_[i] : 0; }
+  char operator[](unsigned int i) const { return charAt(i); }
+  char& operator[](unsigned int i) { return s_[i]; }
+
+  String& operator+=(const String& o) { s_ += o.s_; return *this; }
+  String& operator+=(const char* o) { s_ += o; return *this; }
+  String& operator+=(char c) { s_ += c; return *this; }
+  String& operator+=(int v) { return *this += String(v); }
+  String& operator+=(unsigned int v) { return *this += String(v); }
+  String& operator+=(long v) { return *this += String(v); }
+  String& operator+=(unsigned long v) { return *this += String(v); }
+  bool concat(const String& o) { s_ += o.s_; return true; }
+  bool concat(const char* o) { s_ += o; return true; }
+  bool concat(const char* o, unsigned int n) { s_.append(o, n); return true; }
+  bool concat(char c) { s_ += c; return true; }
+
+  bool operator==(const String& o) const { return s_ == o.s_; }
+  bool operator==(const char* o) const { return s_ == (o ? o : ""); }
+  bool operator!=(const String& o) const { return s_ != o.s_; }
+  bool operator!=(const char* o) const { return !(*this == o); }
+  bool operator<(const String& o) const { return s_ < o.s_; }
+  bool equals(const String& o) const { return s_ == o.s_; }
+  bool equalsIgnoreCase(const String& o) const {
+    if (s_.size() != o.s_.size()) return false;
+    for (size_t i = 0; i < s_.size(); i++) {
+      if (tolower(s_[i]) != tolower(o.s_[i])) return false;
+    }
+    return true;
+  }
+
+  bool startsWith(const String& p) const { return s_.compare(0, p.s_.size(), p.s_) == 0; }
+  bool endsWith(const String& p) const {
+    return s_.size() >= p.s_.size() && s_.compare(s_.size() - p.s_.size(), p.s_.size(), p.s_) == 0;
+  }
+  int indexOf(char c, unsigned int from = 0) const {
+    size_t p = s_.find(c, from);
+    return p == std::string::npos ? -1 : (int)p;
+  }
+  int indexOf(const String& t, unsigned int from = 0) const {
+    size_t p = s_.find(t.s_, from);
+    return p == std::string::npos ? -1 : (int)p;
+  }
+  String substring(unsigned int from) const { return from >= s_.size() ? String() : String(s_.substr(from)); }
+  String substring(unsigned int from, unsigned int to) const {
+    if (from > to) std::swap(from, to);
+    if (from >= s_.size()) return String();
+    return String(s_.substr(from, to - from));
+  }
+  void trim() {
+    size_t b = s_.find_first_not_of(" \t\r\n");
+    if (b == std::string::npos) { s_.clear(); return; }
+    size_t e = s_.find_last_not_of(" \t\r\n");
+    s_ = s_.substr(b, e - b + 1);
+  }
+  void toUpperCase() { for (auto& c : s_) c = toupper(c); }
+  void toLowerCase() { for (auto& c : s_) c = tolower(c); }
+  long toInt() const { return atol(s_.c_str()); }
+  float toFloat() const { return atof(s_.c_str()); }
+  double toDouble() const { return atof(s_.c_str()); }
+  void remove(unsigned int idx) { if (idx < s_.size()) s_.erase(idx); }
+  void remove(unsigned int idx, unsigned int n) { if (idx < s_.size()) s_.erase(idx, n); }
+
+  friend String operator+(const String& a, const String& b) { String r(a); r += b; return r; }
+  friend String operator+(const String& a, const char* b) { String r(a); r += b; return r; }
+  friend String operator+(const char* a, const String& b) { String r(a); r += b; return r; }
+  friend String operator+(const String& a, char b) { String r(a); r += b; return r; }
+
+private:
+  void fromLong(long v, unsigned char base) {
+    if (v < 0 && base == DEC) {
+      s_ = "-";
+      fromULongAppend((unsigned long)(-v), base);
+    } else {
+      fromULong((unsigned long)v, base);
+    }
+  }
+  void fromULong(unsigned long v, unsigned char base) { s_.clear(); fromULongAppend(v, base); }
+  void fromULongAppend(unsigned long v, unsigned char base) {
+    char buf[65];
+    int i = 64;
+    buf[i] = 0;
+    do {
+      int d = v % base;
+      buf[--i] = d < 10 ? '0' + d : 'a' + d - 10;
+      v /= base;
+    } while (v);
+    s_ += &buf[i];
+  }
+  void fromDouble(double v, unsigned int decimals) {
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%.*f", (int)decimals, v);
+    s_ = buf;
+  }
+  std::string s_;
+};
+
+// ============== PRINT / SERIAL ==============
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buf, size_t n) {
+    for (size_t i = 0; i < n; i++) write(buf[i]);
+    return n;
+  }
+  size_t print(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+  size_t print(const String& s) { return print(s.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int v) { return print(String(v)); }
+  size_t print(unsigned int v) { return print(String(v)); }
+  size_t print(long v) { return print(String(v)); }
+  size_t print(unsigned long v) { return print(String(v)); }
+  size_t print(double v, int d = 2) { return print(String(v, d)); }
+  size_t println() { return print("\n"); }
+  template <typename T> size_t println(const T& v) { size_t n = print(v); return n + println(); }
+  size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+    char buf[512];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n > 0) print(buf);
+    return n > 0 ? n : 0;
+  }
+};
+
+class Stream : public Print {
+public:
+  virtual int available() { return 0; }
+  virtual int read() { return -1; }
+  virtual int peek() { return -1; }
+  size_t readBytes(uint8_t* buf, size_t n) {
+    size_t i = 0;
+    while (i < n) {
+      int c = read();
+      if (c < 0) break;
+      buf[i++] = (uint8_t)c;
+    }
+    return i;
+  }
+  size_t readBytes(char* buf, size_t n) { return readBytes((uint8_t*)buf, n); }
+  String readStringUntil(char term) {
+    String out;
+    int c;
+    while ((c = read()) >= 0 && c != term) out += (char)c;
+    return out;
+  }
+  void setTimeout(unsigned long) {}
+};
+
+// Output is discarded unless sim::setSerialEcho(true); lines are prefixed
+// with the virtual time and the node that printed them
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long) {}
+  size_t write(uint8_t c) override;
+  operator bool() const { return true; }
+};
+
+extern HardwareSerial Serial;
+
+// ============== ESP ==============
+// Heap figures come from the simulator's per-node allocation accounting
+class EspClass {
+public:
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap();
+  uint32_t getMaxAllocHeap() { return getFreeHeap(); }
+  uint32_t getHeapSize();
+  uint64_t getEfuseMac();
+  void restart() {}
+  uint32_t getFreePsram() { return 0; }
+  uint32_t getPsramSize() { return 0; }
+};
+inline bool psramFound() { return false; }
+inline void* ps_malloc(size_t n) { return malloc(n); }
+
+extern EspClass ESP;
+
+#endif // MESHSWARM_SIM_ARDUINO_H
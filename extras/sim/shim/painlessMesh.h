@@ -0,0 +1,120 @@
+/*
+ * MeshSwarm Host Simulator - painlessMesh shim
+ *
+ * Mirrors the subset of the painlessMesh API used by MeshSwarm. Every
+ * instance registers with the process-wide sim::Network (SimNetwork.h),
+ * which routes frames over a simulated spanning tree with per-hop latency,
+ * jitter and loss. As on the real library, received frames and connection
+ * events are queued and only dispatched from update().
+ */
+
+#ifndef MESHSWARM_SIM_PAINLESSMESH_H
+#define MESHSWARM_SIM_PAINLESSMESH_H
+
+#include <Arduino.h>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+
+#define ERROR       (1 << 0)
+#define STARTUP     (1 << 1)
+#define CONNECTION  (1 << 2)
+
+#define TSTRING String
+
+class Task {};
+
+namespace painlessmesh {
+namespace protocol {
+struct NodeTree {
+  uint32_t nodeId = 0;
+  bool root = false;
+  std::list<NodeTree> subs;
+};
+}  // namespace protocol
+
+namespace plugin {
+namespace ota {
+struct DataRequest {
+  uint32_t from = 0;
+  uint32_t dest = 0;
+  TSTRING md5;
+  TSTRING hardware;
+  TSTRING nodeType;
+  bool forced = false;
+  size_t noPart = 0;
+  size_t partNo = 0;
+};
+}  // namespace ota
+}  // namespace plugin
+}  // namespace painlessmesh
+
+typedef std::function<void(uint32_t from, String& msg)> receivedCallback_t;
+typedef std::function<void(uint32_t nodeId)> newConnectionCallback_t;
+typedef std::function<void(uint32_t nodeId)> droppedConnectionCallback_t;
+typedef std::function<void()> changedConnectionsCallback_t;
+typedef std::function<void(uint32_t nodeId, int32_t delay)> nodeDelayCallback_t;
+typedef std::function<size_t(painlessmesh::plugin::ota::DataRequest, char* buffer)> otaDataPacketCallbackType;
+
+namespace sim {
+// Something for one node's update() to dispatch
+struct MeshEvent {
+  enum Kind { RECEIVED, NEW_CONNECTION, DROPPED_CONNECTION, CHANGED_CONNECTIONS, NODE_DELAY };
+  Kind kind;
+  uint32_t from;
+  int32_t delayUs;
+  String msg;
+};
+}  // namespace sim
+
+class painlessMesh {
+public:
+  painlessMesh();
+  ~painlessMesh();
+
+  void setDebugMsgTypes(uint16_t) {}
+  void init(TSTRING prefix, TSTRING password, uint16_t port = 5555);
+  void update();
+  void stop();
+
+  bool sendSingle(uint32_t dest, TSTRING msg);
+  bool sendBroadcast(TSTRING msg, bool includeSelf = false);
+
+  uint32_t getNodeId() { return nodeId; }
+  uint32_t getNodeTime() { return (uint32_t)micros(); }
+  std::list<uint32_t> getNodeList(bool includeSelf = false);
+  painlessmesh::protocol::NodeTree asNodeTree();
+  bool isConnected(uint32_t nodeId);
+  bool startDelayMeas(uint32_t nodeId);
+
+  void onReceive(receivedCallback_t cb) { receivedCb = cb; }
+  void onNewConnection(newConnectionCallback_t cb) { newConnectionCb = cb; }
+  void onDroppedConnection(droppedConnectionCallback_t cb) { droppedConnectionCb = cb; }
+  void onChangedConnections(changedConnectionsCallback_t cb) { changedConnectionsCb = cb; }
+  void onNodeDelayReceived(nodeDelayCallback_t cb) { nodeDelayCb = cb; }
+
+  void stationManual(TSTRING, TSTRING) {}
+  void initOTASend(otaDataPacketCallbackType, size_t = 0) {}
+  std::shared_ptr<Task> offerOTA(TSTRING, TSTRING, TSTRING, size_t, bool = false) {
+    return std::make_shared<Task>();
+  }
+  void initOTAReceive(TSTRING = "") {}
+
+  // Simulator hooks (used by sim::Network)
+  void post(sim::MeshEvent&& event) { inbox.push_back(std::move(event)); }
+  int simIndex() const { return index; }
+
+private:
+  uint32_t nodeId;
+  int index;                        // Creation order, used for attribution
+  std::deque<sim::MeshEvent> inbox;
+
+  receivedCallback_t receivedCb;
+  newConnectionCallback_t newConnectionCb;
+  droppedConnectionCallback_t droppedConnectionCb;
+  changedConnectionsCallback_t changedConnectionsCb;
+  nodeDelayCallback_t nodeDelayCb;
+};
+
+#endif // MESHSWARM_SIM_PAINLESSMESH_H
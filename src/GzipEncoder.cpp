@@ -0,0 +1,193 @@
+/**
+ * GzipEncoder - Implementation
+ */
+
+#include "GzipEncoder.h"
+#include <string.h>
+
+static const size_t GZIP_HASH_SIZE = (size_t)1 << GZIP_HASH_BITS;
+static const size_t GZIP_MIN_MATCH = 3;
+static const size_t GZIP_MAX_MATCH = 258;
+static const size_t GZIP_WINDOW = 32768;
+
+// RFC 1951 3.2.5: base value and extra bits of each length and distance code
+static const uint16_t lengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t lengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t distanceBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t distanceExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+// CRC-32 (the gzip trailer), four bits at a time
+static const uint32_t crcNibble[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+static uint32_t gzipCrc32(const uint8_t* data, size_t len) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ crcNibble[crc & 0x0F];
+        crc = (crc >> 4) ^ crcNibble[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+static inline uint32_t gzipHash(const uint8_t* p) {
+    uint32_t v = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+    return (v * 2654435761u) >> (32 - GZIP_HASH_BITS);
+}
+
+GzipEncoder::~GzipEncoder() {
+    release();
+}
+
+void GzipEncoder::release() {
+    free(_out);
+    free(_heads);
+    _out = nullptr;
+    _heads = nullptr;
+    _size = 0;
+    _capacity = 0;
+}
+
+bool GzipEncoder::reserve(size_t capacity) {
+    if (capacity <= _capacity) {
+        return true;
+    }
+    uint8_t* grown = (uint8_t*)realloc(_out, capacity);
+    if (!grown) {
+        return false;
+    }
+    _out = grown;
+    _capacity = capacity;
+    return true;
+}
+
+// ============== BIT OUTPUT ==============
+// Deflate packs bits LSB first; reserve() has already made room
+
+void GzipEncoder::putBits(uint32_t bits, uint8_t count) {
+    _bitBuffer |= bits << _bitCount;
+    _bitCount += count;
+    while (_bitCount >= 8) {
+        _out[_size++] = (uint8_t)_bitBuffer;
+        _bitBuffer >>= 8;
+        _bitCount -= 8;
+    }
+}
+
+// Huffman codes are defined MSB first
+void GzipEncoder::putCode(uint32_t code, uint8_t length) {
+    uint32_t reversed = 0;
+    for (uint8_t i = 0; i < length; i++) {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    putBits(reversed, length);
+}
+
+// Fixed literal/length code (RFC 1951 3.2.6)
+void GzipEncoder::putLiteral(uint16_t symbol) {
+    if (symbol < 144) {
+        putCode(0x30 + symbol, 8);
+    } else if (symbol < 256) {
+        putCode(0x190 + (symbol - 144), 9);
+    } else if (symbol < 280) {
+        putCode(symbol - 256, 7);
+    } else {
+        putCode(0xC0 + (symbol - 280), 8);
+    }
+}
+
+void GzipEncoder::putMatch(size_t length, size_t distance) {
+    int code = 28;
+    while (lengthBase[code] > length) code--;
+    putLiteral(257 + code);
+    putBits(length - lengthBase[code], lengthExtra[code]);
+
+    code = 29;
+    while (distanceBase[code] > distance) code--;
+    putCode(code, 5);
+    putBits(distance - distanceBase[code], distanceExtra[code]);
+}
+
+// ============== ENCODING ==============
+
+bool GzipEncoder::encode(const uint8_t* input, size_t len) {
+    _size = 0;
+    if (len > GZIP_MAX_INPUT) {
+        return false;
+    }
+    if (!_heads) {
+        _heads = (uint16_t*)malloc(GZIP_HASH_SIZE * sizeof(uint16_t));
+        if (!_heads) return false;
+    }
+    // Fixed codes cost at most 9 bits per input byte, plus header and trailer
+    if (!reserve(len + len / 8 + 32)) {
+        return false;
+    }
+    memset(_heads, 0, GZIP_HASH_SIZE * sizeof(uint16_t));
+    _bitBuffer = 0;
+    _bitCount = 0;
+
+    // gzip header: deflate, no flags, no mtime, unknown OS
+    static const uint8_t header[10] = { 0x1F, 0x8B, 0x08, 0, 0, 0, 0, 0, 0, 0xFF };
+    memcpy(_out, header, sizeof(header));
+    _size = sizeof(header);
+
+    putBits(1, 1);      // BFINAL
+    putBits(1, 2);      // BTYPE = fixed Huffman
+
+    size_t pos = 0;
+    while (pos < len) {
+        size_t matchLen = 0;
+        size_t distance = 0;
+        if (pos + GZIP_MIN_MATCH <= len) {
+            uint32_t h = gzipHash(input + pos);
+            size_t candidate = _heads[h];
+            _heads[h] = (uint16_t)(pos + 1);
+            if (candidate && pos - (candidate - 1) <= GZIP_WINDOW) {
+                candidate--;
+                distance = pos - candidate;
+                size_t limit = len - pos < GZIP_MAX_MATCH ? len - pos : GZIP_MAX_MATCH;
+                while (matchLen < limit && input[candidate + matchLen] == input[pos + matchLen]) {
+                    matchLen++;
+                }
+            }
+        }
+
+        if (matchLen >= GZIP_MIN_MATCH) {
+            putMatch(matchLen, distance);
+            // Index the covered positions so later matches can start there
+            for (size_t i = pos + 1; i < pos + matchLen && i + GZIP_MIN_MATCH <= len; i++) {
+                _heads[gzipHash(input + i)] = (uint16_t)(i + 1);
+            }
+            pos += matchLen;
+        } else {
+            putLiteral(input[pos]);
+            pos++;
+        }
+    }
+
+    putLiteral(256);    // End of block
+    if (_bitCount > 0) {
+        putBits(0, 8 - _bitCount);
+    }
+
+    // Trailer: CRC-32 and input size, little endian
+    uint32_t crc = gzipCrc32(input, len);
+    for (int i = 0; i < 4; i++) _out[_size++] = (uint8_t)(crc >> (8 * i));
+    for (int i = 0; i < 4; i++) _out[_size++] = (uint8_t)(len >> (8 * i));
+    return true;
+}
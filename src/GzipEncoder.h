@@ -0,0 +1,74 @@
+/**
+ * GzipEncoder - Small gzip compressor for HTTP request bodies
+ *
+ * Telemetry uploads are JSON with the same keys repeated for every node,
+ * which deflate shrinks well even without dynamic Huffman tables.
+ * GzipEncoder writes the whole input as one fixed-Huffman deflate block
+ * (RFC 1951, 3.2.6) in a gzip member (RFC 1952):
+ * - Greedy LZ77 matching with one hash table of recent positions
+ * - The hash table and output buffer are kept between calls, so a steady
+ *   stream of uploads does not allocate
+ * - Inputs over GZIP_MAX_INPUT are refused; send those uncompressed
+ *
+ * Not thread safe: guard a shared encoder with the caller's own lock.
+ */
+
+#ifndef GZIP_ENCODER_H
+#define GZIP_ENCODER_H
+
+#include <Arduino.h>
+
+// Build-time configuration defaults
+#ifndef GZIP_HASH_BITS
+#define GZIP_HASH_BITS  11      // 2^N hash slots of 2 bytes each
+#endif
+
+#define GZIP_MAX_INPUT  65535   // Positions are stored in 16 bits
+
+/**
+ * GzipEncoder class
+ *
+ * Usage:
+ *   GzipEncoder gzip;
+ *   if (gzip.encode((const uint8_t*)body.c_str(), body.length())) {
+ *     send(gzip.data(), gzip.size());
+ *   }
+ */
+class GzipEncoder {
+public:
+    GzipEncoder() = default;
+    ~GzipEncoder();
+
+    GzipEncoder(const GzipEncoder&) = delete;
+    GzipEncoder& operator=(const GzipEncoder&) = delete;
+
+    /**
+     * Compresses len bytes into data()/size(). False if the input is too
+     * large or memory ran out.
+     */
+    bool encode(const uint8_t* input, size_t len);
+
+    const uint8_t* data() const { return _out; }
+    size_t size() const { return _size; }
+
+    /**
+     * Frees the hash table and output buffer
+     */
+    void release();
+
+private:
+    bool reserve(size_t capacity);
+    void putBits(uint32_t bits, uint8_t count);
+    void putCode(uint32_t code, uint8_t length);
+    void putLiteral(uint16_t symbol);
+    void putMatch(size_t length, size_t distance);
+
+    uint8_t* _out = nullptr;
+    size_t _size = 0;
+    size_t _capacity = 0;
+    uint16_t* _heads = nullptr; // Last position + 1 per hash, 0 = none
+    uint32_t _bitBuffer = 0;
+    uint8_t _bitCount = 0;
+};
+
+#endif // GZIP_ENCODER_H
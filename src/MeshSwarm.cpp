@@ -3,19 +3,54 @@
  */
 
 #include "MeshSwarm.h"
+#include <algorithm>
+#include <climits>
 
 // ============== CONSTRUCTOR ==============
 MeshSwarm::MeshSwarm()
   : 
 #if MESHSWARM_ENABLE_DISPLAY
     display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET),
+#endif
+    deferredWatchers(MESHSWARM_ENABLE_THREADED != 0),  // Threaded: never on the mesh task
+    watchQueueHead(0),
+    alivePeerCount(0),
+    pendingStateCount(0),
+    pendingStateSince(0),
+    stateVersion(0),
+    partialReplica(false),
+    fullReplica(true),
+#if MESHSWARM_ENABLE_STATE_SNAPSHOT
+    snapshotVersion(0),
+    snapshotHash(0),
+    snapshotDirty(false),
+    snapshotDirtySince(0),
+    lastSnapshotWrite(0),
 #endif
     myId(0),
     myName(""),
-    myRole("PEER"),
+    myRole(ROLE_PEER),
     coordinatorId(0),
+    meshCaps(0),
+#if MESHSWARM_ENABLE_KEY_SCHEMA
+    keySchema{nullptr, 0, 0},
+    keySchemaShared(false),
+#endif
     lastHeartbeat(0),
-    lastStateSync(0)
+    lastPeerCheck(0),
+    lastLinkProbe(0),
+    lastProbedPeer(0),
+    peerHopsDirty(true),
+    heartbeatSeq(0),
+    heartbeatInterval(HEARTBEAT_INTERVAL),
+    lastStateSync(0),
+    lastStateExpire(0)
+#if MESHSWARM_ENABLE_ADAPTIVE_HEARTBEAT
+    ,heartbeatFull(true)
+    ,heartbeatsSinceFull(0)
+    ,heartbeatAsk(false)
+    ,lastBroadcast(0)
+#endif
 #if MESHSWARM_ENABLE_DISPLAY
     ,lastDisplayUpdate(0)
 #endif
@@ -30,6 +65,26 @@ MeshSwarm::MeshSwarm()
     ,telemetryInterval(TELEMETRY_INTERVAL)
     ,telemetryEnabled(false)
     ,gatewayMode(false)
+    ,telemetryGateway(0)
+    ,telemetryDelta(false)
+    ,telemetryHasKeyframe(false)
+    ,telemetrySeq(0)
+    ,telemetrySince(0)
+    ,telemetryKeyframeAt(0)
+    ,uplinkMutex(nullptr)
+    ,uplinkTask(nullptr)
+    ,uplinkBatchSupported(true)
+#endif
+#if MESHSWARM_LOCKING
+    ,meshMutex(nullptr)
+#endif
+#if MESHSWARM_ENABLE_THREADED
+    ,meshTask(nullptr)
+#endif
+#if MESHSWARM_ENABLE_HTTP_SERVER
+    ,apiServer(nullptr)
+    ,apiEvents(nullptr)
+    ,apiEpoch(0)
 #endif
 #if MESHSWARM_ENABLE_OTA
     ,otaDistributionEnabled(false)
@@ -38,17 +93,105 @@ MeshSwarm::MeshSwarm()
     ,otaFirmwareSize(0)
     ,otaLastPartSent(-1)
     ,otaTransferStarted(false)
+#if MESHSWARM_ENABLE_TELEMETRY
+    ,otaCacheType(OTA_CACHE_NONE)
+    ,otaCachePartition(nullptr)
+    ,otaPrefetchStage(nullptr)
+    ,otaPrefetchOffset(0)
+    ,otaPrefetchFailures(0)
+    ,otaPrefetching(false)
+    ,otaOffered(false)
+    ,otaCompletedUpdate(0)
+    ,otaPartSize(OTA_PART_SIZE)
+    ,otaReadahead(nullptr)
+    ,otaReadaheadHalf(0)
+    ,otaReadaheadStart()
+    ,otaReadaheadLen()
+    ,otaReadaheadWant(0)
+    ,otaReadaheadFill(-1)
+    ,otaRepeatPermille(0)
+#endif
+#endif
+#if MESHSWARM_ENABLE_TELEMETRY || MESHSWARM_ENABLE_OTA
+    ,httpTlsClient(nullptr)
+    ,httpOrigin("")
+    ,httpSecure(false)
+    ,httpLastReused(false)
+    ,httpMutex(nullptr)
+    ,httpCompress(false)
+#endif
+#if MESHSWARM_ENABLE_SERIAL
+    ,serialLineLen(0)
+    ,serialLineOverflow(false)
+    ,serialLastByte(0)
 #endif
 #if MESHSWARM_ENABLE_DISPLAY
-    ,lastStateChange("")
-    ,customStatus("")
+    ,displayDirty(true)
+    ,displayFlushAll(true)
+    ,displayUptime(0)
+#endif
+    ,msgArena(MSG_ARENA_SIZE)
+#if MESHSWARM_ENABLE_BINARY_WIRE
+    ,binaryWireEnabled(true)
+#endif
+#if MESHSWARM_ENABLE_TX_SCHEDULER
+    ,txNodeTokens(TX_NODE_BURST)
+    ,txLastRefill(0)
+    ,txWindowBytes(0)
+    ,txWindowStart(0)
+#endif
+#if MESHSWARM_ENABLE_DIGEST_SYNC
+    ,digestValid(false)
+    ,lastRepair(0)
+#endif
+#if MESHSWARM_ENABLE_PERF
+    ,perfTelemetryEnabled(false)
+    ,lastPerfHeapSample(0)
 #endif
 {
+  stateStats = StateStats();
+#if MESHSWARM_ENABLE_STATE_SNAPSHOT
+  snapshotStats = SnapshotStats();
+#endif
+  sharedState.setLimits(STATE_MAX_ENTRIES, STATE_MAX_BYTES, STATE_MAX_TOMBSTONES);
+#if MESHSWARM_ENABLE_PERF
+  resetPerfStats();
+#endif
 #if MESHSWARM_ENABLE_OTA
   // Initialize OTA update info
   currentOTAUpdate.active = false;
   currentOTAUpdate.updateId = 0;
 #endif
+#if MESHSWARM_ENABLE_TELEMETRY
+  uplinkStats = UplinkStats();
+#endif
+#if MESHSWARM_ENABLE_TELEMETRY || MESHSWARM_ENABLE_OTA
+  httpStats = HttpStats();
+#endif
+#if MESHSWARM_ENABLE_BINARY_WIRE
+  wireStats = WireStats();
+#endif
+#if MESHSWARM_ENABLE_ADAPTIVE_HEARTBEAT
+  heartbeatStats = HeartbeatStats();
+#endif
+#if MESHSWARM_ENABLE_TX_SCHEDULER
+  txStats = TxStats();
+  // Buckets start full
+  txClassTokens[TX_STATE] = 0;
+  txClassTokens[TX_HEARTBEAT] = TX_RATE_HEARTBEAT;
+  txClassTokens[TX_SYNC] = TX_RATE_SYNC;
+  txClassTokens[TX_TELEMETRY] = TX_RATE_TELEMETRY;
+#endif
+#if MESHSWARM_ENABLE_SERIAL
+  initSerialCommands();
+#endif
+#if MESHSWARM_ENABLE_DISPLAY
+  lastStateChange[0] = 0;
+  customStatus[0] = 0;
+  // No line matches, so the first frame draws all of them
+  memset(displayLines, 0xFF, sizeof(displayLines));
+  memset(displayPageHash, 0, sizeof(displayPageHash));
+#endif
 }
 
 // ============== INITIALIZATION ==============
@@ -57,6 +200,12 @@ void MeshSwarm::begin(const char* nodeName) {
 }
 
 void MeshSwarm::begin(const char* prefix, const char* password, uint16_t port, const char* nodeName) {
+#if MESHSWARM_LOCKING
+  // Created before the mesh task or HTTP server can exist
+  if (!meshMutex) {
+    meshMutex = xSemaphoreCreateRecursiveMutex();
+  }
+#endif
 #if MESHSWARM_ENABLE_SERIAL
   Serial.begin(115200);
   delay(1000);
@@ -82,18 +231,34 @@ void MeshSwarm::begin(const char* prefix, const char* password, uint16_t port, c
   // Initialize mesh
   initMesh(prefix, password, port);
 
+#if MESHSWARM_ENABLE_TELEMETRY || MESHSWARM_ENABLE_OTA
+  // Shared HTTP connection (mutex must exist before the uplink task starts)
+  httpInit();
+#endif
+
   myId = mesh.getNodeId();
   myName = nodeName ? String(nodeName) : nodeIdToName(myId);
   bootTime = millis();
+  txBuffer.reserve(MSG_TX_BUFFER_SIZE);
+#if MESHSWARM_ENABLE_STATE_SNAPSHOT
+  // Before the first mesh.update(), so the first digest already matches
+  restoreStateSnapshot();
+#endif
+  refreshNodeList();
+  electCoordinator();
 
   MESH_LOG("Node ID: %u", myId);
   MESH_LOG("Name: %s", myName.c_str());
 #if MESHSWARM_ENABLE_SERIAL
   Serial.println();
-  Serial.println("Commands: status, peers, state, set <k> <v>, get <k>, sync, reboot");
+  cmdHelp(String());
   Serial.println("----------------------------------------");
   Serial.println();
 #endif
+
+#if MESHSWARM_ENABLE_THREADED
+  startMeshTask();
+#endif
 }
 
 // initDisplay() is defined in features/MeshSwarmDisplay.inc
@@ -118,41 +283,111 @@ void MeshSwarm::initMesh(const char* prefix, const char* password, uint16_t port
   mesh.onChangedConnections([this]() {
     this->onChangedConnections();
   });
+
+  mesh.onNodeDelayReceived([this](uint32_t nodeId, int32_t delay) {
+    this->onNodeDelay(nodeId, delay);
+  });
 }
 
 // ============== MAIN LOOP ==============
 void MeshSwarm::update() {
-  mesh.update();
+  MESHSWARM_PERF_SCOPE(PERF_LOOP);
+
+#if MESHSWARM_ENABLE_THREADED
+  // Once the mesh task runs, the calling task only does local I/O
+  if (!meshTask) {
+    MESHSWARM_LOCK();
+    updateMesh();
+  }
+#else
+  {
+    MESHSWARM_LOCK();
+    updateMesh();
+  }
+#endif
+  updateLocal();
+}
+
+// Everything that touches the mesh: from update(), or the mesh task
+void MeshSwarm::updateMesh() {
+  {
+    MESHSWARM_PERF_SCOPE(PERF_MESH_UPDATE);
+    mesh.update();
+  }
+
+#if MESHSWARM_ENABLE_TX_SCHEDULER
+  // Deferred frames, most urgent class first
+  serviceTxQueues();
+#endif
 
   unsigned long now = millis();
 
-  // Heartbeat
-  if (now - lastHeartbeat >= HEARTBEAT_INTERVAL) {
-    sendHeartbeat();
+  // Heartbeat, whose interval may be stretched, and peer timeouts, which
+  // are checked at the base interval
+  if (now - lastPeerCheck >= HEARTBEAT_INTERVAL) {
+    MESHSWARM_PERF_SCOPE(PERF_HEARTBEAT);
+    if (now - lastHeartbeat >= heartbeatInterval) {
+      serviceHeartbeat();
+      lastHeartbeat = now;
+    }
     pruneDeadPeers();
-    lastHeartbeat = now;
+    refreshPeerHops();
+    lastPeerCheck = now;
   }
 
-  // Periodic full state sync
-  if (now - lastStateSync >= STATE_SYNC_INTERVAL) {
-    broadcastFullState();
-    lastStateSync = now;
+  // Link quality: one delay probe per interval
+  if (LINK_PROBE_INTERVAL > 0 && now - lastLinkProbe >= LINK_PROBE_INTERVAL) {
+    probeNextPeer();
+    lastLinkProbe = now;
   }
 
-#if MESHSWARM_ENABLE_DISPLAY
-  // Display power manager update (polls buttons, checks timeout)
-  powerManager.update();
+  // Coalesced local state changes
+  if (pendingStateCount > 0 && now - pendingStateSince >= STATE_FLUSH_WINDOW) {
+    MESHSWARM_PERF_SCOPE(PERF_STATE_FLUSH);
+    flushPendingState();
+  }
+
+  // TTL expiry (before the sync below, so expired keys are not sent)
+  if (now - lastStateExpire >= STATE_EXPIRE_INTERVAL) {
+    expireState();
+    lastStateExpire = now;
+  }
+
+#if MESHSWARM_ENABLE_STATE_SNAPSHOT
+  serviceStateSnapshot(now);
+#endif
+
+  // Delayed MSG_STATE_REQ replies nobody else claimed
+  if (!pendingSyncReplies.empty()) {
+    processSyncReplies(now);
+  }
 
-  // Display update (skip if display is sleeping)
-  if (!powerManager.isAsleep() && (now - lastDisplayUpdate >= DISPLAY_INTERVAL)) {
-    updateDisplay();
-    lastDisplayUpdate = now;
+#if MESHSWARM_ENABLE_DIGEST_SYNC
+  // Repairs batched while the last one went out
+  if (!repairBatchPeers.empty()) {
+    flushRepairBatch(now);
   }
 #endif
 
+  // Periodic state sync (digest exchange once the whole mesh supports it)
+  if (now - lastStateSync >= STATE_SYNC_INTERVAL) {
+    MESHSWARM_PERF_SCOPE(PERF_STATE_SYNC);
+#if MESHSWARM_ENABLE_DIGEST_SYNC
+    if (meshCaps & CAP_DIGEST_SYNC) {
+      broadcastStateDigest();
+    } else {
+      broadcastFullState();
+    }
+#else
+    broadcastFullState();
+#endif
+    lastStateSync = now;
+  }
+
 #if MESHSWARM_ENABLE_TELEMETRY
   // Telemetry push
   if (telemetryEnabled && (now - lastTelemetryPush >= telemetryInterval)) {
+    MESHSWARM_PERF_SCOPE(PERF_TELEMETRY);
     if (gatewayMode) {
       // Gateway pushes its own telemetry directly
       pushTelemetry();
@@ -163,112 +398,223 @@ void MeshSwarm::update() {
     lastTelemetryPush = now;
   }
 #endif
+}
+
+// Work that stays on the task calling update()
+void MeshSwarm::updateLocal() {
+  // Deferred watchers (the mesh task may be queuing more)
+  bool watchersQueued;
+  {
+    MESHSWARM_LOCK();
+    watchersQueued = watchQueueHead < watchQueue.size();
+  }
+  if (watchersQueued) {
+    MESHSWARM_PERF_SCOPE(PERF_WATCHERS);
+    dispatchWatchers();
+  }
+
+#if MESHSWARM_ENABLE_DISPLAY
+  {
+    MESHSWARM_PERF_SCOPE(PERF_DISPLAY);
+    unsigned long now = millis();
+
+    // Display power manager update (polls buttons, checks timeout)
+    powerManager.update();
+
+    // Display update (skip if display is sleeping)
+    if (!powerManager.isAsleep() && (now - lastDisplayUpdate >= DISPLAY_INTERVAL)) {
+      updateDisplay();
+      lastDisplayUpdate = now;
+    }
+  }
+#endif
 
 #if MESHSWARM_ENABLE_SERIAL
-  // Serial commands
-  if (Serial.available()) {
+  // Serial commands (also runs a pending line without terminator)
+  if (Serial.available() || serialLineLen > 0) {
+    MESHSWARM_PERF_SCOPE(PERF_SERIAL);
     processSerial();
   }
 #endif
 
 #if MESHSWARM_ENABLE_CALLBACKS
   // Custom loop callbacks
-  for (auto& cb : loopCallbacks) {
-    cb();
+  if (!loopCallbacks.empty()) {
+    MESHSWARM_PERF_SCOPE(PERF_CALLBACKS);
+    for (auto& cb : loopCallbacks) {
+      cb();
+    }
+  }
+#endif
+
+#if MESHSWARM_ENABLE_PERF
+  unsigned long now = millis();
+  if (now - lastPerfHeapSample >= PERF_HEAP_SAMPLE_INTERVAL) {
+    samplePerfHeap();
+    lastPerfHeapSample = now;
   }
 #endif
 }
 
 // ============== STATE MANAGEMENT ==============
-bool MeshSwarm::setState(const String& key, const String& value) {
-  String oldValue = "";
-  uint32_t newVersion = 1;
 
-  if (sharedState.count(key)) {
-    oldValue = sharedState[key].value;
-    newVersion = sharedState[key].version + 1;
+// millis() deadline for a TTL; 0 is reserved for "no TTL"
+static unsigned long stateDeadline(unsigned long now, uint32_t ttlMs) {
+  unsigned long deadline = now + ttlMs;
+  return deadline ? deadline : 1;
+}
 
-    if (oldValue == value) {
-      return false;
-    }
-  }
+static bool stateExpired(const StateEntry& entry, unsigned long now) {
+  return entry.expiresAt != 0 && (long)(now - entry.expiresAt) >= 0;
+}
 
-  StateEntry entry;
-  entry.value = value;
-  entry.version = newVersion;
-  entry.origin = myId;
-  entry.timestamp = millis();
-  sharedState[key] = entry;
+bool MeshSwarm::setState(const String& key, const String& value, uint32_t ttlMs) {
+  return setStateValue(key, StateValue::fromString(value.c_str(), value.length()), ttlMs);
+}
 
-  triggerWatchers(key, value, oldValue);
-  broadcastState(key);
-#if MESHSWARM_ENABLE_DISPLAY
-  lastStateChange = key + "=" + value;
-#endif
+bool MeshSwarm::setState(const String& key, const char* value, uint32_t ttlMs) {
+  return setStateValue(key, StateValue::fromString(value, strlen(value)), ttlMs);
+}
 
-#if MESHSWARM_ENABLE_TELEMETRY
-  // Push telemetry on state change (with debouncing)
-  unsigned long now = millis();
-  if (telemetryEnabled) {
-    if (now - lastStateTelemetryPush >= STATE_TELEMETRY_MIN_INTERVAL) {
-      TELEM_LOG("State change push for %s=%s", key.c_str(), value.c_str());
-      if (gatewayMode) {
-        pushTelemetry();
-      } else {
-        sendTelemetryToGateway();
-      }
-      lastTelemetryPush = now;
-      lastStateTelemetryPush = now;
-    } else {
-      TELEM_LOG_D("Debounced %s=%s (wait %lums)", key.c_str(), value.c_str(),
-                  STATE_TELEMETRY_MIN_INTERVAL - (now - lastStateTelemetryPush));
-    }
+bool MeshSwarm::setState(const String& key, int value, uint32_t ttlMs) {
+  return setStateValue(key, StateValue::fromInt(value), ttlMs);
+}
+
+bool MeshSwarm::setState(const String& key, float value, uint32_t ttlMs) {
+  return setStateValue(key, StateValue::fromFloat(value), ttlMs);
+}
+
+bool MeshSwarm::setState(const String& key, bool value, uint32_t ttlMs) {
+  return setStateValue(key, StateValue::fromBool(value), ttlMs);
+}
+
+bool MeshSwarm::setStateBytes(const String& key, const uint8_t* data, size_t len, uint32_t ttlMs) {
+  char* encoded = (char*)malloc(StateStore::base64Length(len) + 1);
+  if (!encoded) {
+    return false;
   }
-#endif
+  StateStore::base64Encode(data, len, encoded);
+  bool changed = setStateValue(key, StateValue::fromBase64(encoded, StateStore::base64Length(len)), ttlMs);
+  free(encoded);
+  return changed;
+}
 
+bool MeshSwarm::setStateValue(const String& key, const StateValue& value, uint32_t ttlMs) {
+  MESHSWARM_LOCK();
+  if (!applyLocalState(key, value, ttlMs)) {
+    return false;
+  }
+  if (STATE_FLUSH_WINDOW == 0) {
+    flushPendingState();
+  }
   return true;
 }
 
 bool MeshSwarm::setStates(std::initializer_list<std::pair<String, String>> states) {
+  MESHSWARM_LOCK();
   bool anyChanged = false;
 
   for (const auto& kv : states) {
-    const String& key = kv.first;
-    const String& value = kv.second;
+    if (applyLocalState(kv.first, StateValue::fromString(kv.second.c_str(), kv.second.length()))) {
+      anyChanged = true;
+    }
+  }
 
-    String oldValue = "";
-    uint32_t newVersion = 1;
+  if (anyChanged && STATE_FLUSH_WINDOW == 0) {
+    flushPendingState();
+  }
+  return anyChanged;
+}
 
-    if (sharedState.count(key)) {
-      oldValue = sharedState[key].value;
-      newVersion = sharedState[key].version + 1;
+// Stores a local write with a single lookup, queues it for the next flush
+// and runs watchers. Returns false if the value is unchanged (or could not
+// be stored). A write with a TTL always renews the lease, even when the
+// value is the same, so it is re-broadcast with the new deadline.
+bool MeshSwarm::applyLocalState(const String& key, const StateValue& value, uint32_t ttlMs) {
+  bool created;
+  StateEntry* entry = sharedState.findOrCreate(key, &created);
+  if (!entry) {
+    STATE_LOG("Out of memory storing %s", key.c_str());
+    return false;
+  }
+  bool same = !created && entry->equals(value);
+  if (same && ttlMs == 0 && entry->expiresAt == 0) {
+    return false;
+  }
 
-      if (oldValue == value) {
-        continue;  // Skip unchanged values
-      }
+  if (created) {
+    registerStateKey(entry);
+    // Continue from a tombstone so the write outranks the removal mesh-wide
+    const StateTombstone* tomb = sharedState.findTombstone(key.c_str(), key.length());
+    if (tomb) {
+      entry->version = tomb->version;
+      sharedState.clearTombstone(key.c_str(), key.length());
     }
+  }
 
-    StateEntry entry;
-    entry.value = value;
-    entry.version = newVersion;
-    entry.origin = myId;
-    entry.timestamp = millis();
-    sharedState[key] = entry;
+  String oldValue = created ? String() : String(entry->value());
+  if (!same && !sharedState.setValue(entry, value)) {
+    STATE_LOG("Out of memory storing %s", key.c_str());
+    return false;
+  }
+  unsigned long now = millis();
+  entry->version++;
+  entry->origin = myId;
+  entry->timestamp = now;
+  entry->lastUsed = now;
+  entry->expiresAt = ttlMs ? stateDeadline(now, ttlMs) : 0;
+#if MESHSWARM_ENABLE_DIGEST_SYNC
+  digestValid = false;
+#endif
 
-    triggerWatchers(key, value, oldValue);
-    broadcastState(key);
+  // Repeated writes within the flush window collapse into one pending entry
+  if (!entry->pending) {
+    entry->pending = true;
+    if (pendingStateCount++ == 0) {
+      pendingStateSince = entry->timestamp;
+    }
+  }
+
+  if (!same) {
+    String valueStr(entry->value());
+    triggerWatchers(key, valueStr, oldValue);
 #if MESHSWARM_ENABLE_DISPLAY
-    lastStateChange = key + "=" + value;
+    noteStateChange(key.c_str(), valueStr.c_str());
 #endif
-    anyChanged = true;
   }
+  enforceStateBudget();
+  return true;
+}
+
+// Sends everything written locally since the last flush: one MSG_STATE_SET
+// for a single key, otherwise one (chunked) multi-entry MSG_STATE_SYNC.
+// State-triggered telemetry is driven from here as well.
+void MeshSwarm::flushPendingState() {
+  if (pendingStateCount == 0) return;
+
+  if (pendingStateCount == 1) {
+    for (StateEntry& e : sharedState) {
+      if (e.pending) {
+        broadcastState(e);
+        break;
+      }
+    }
+  } else {
+    sendStateEntries(0, nullptr, true);
+  }
+  STATE_LOG_D("Flushed %u pending entries", pendingStateCount);
+
+  for (StateEntry& e : sharedState) {
+    e.pending = false;
+  }
+  pendingStateCount = 0;
 
 #if MESHSWARM_ENABLE_TELEMETRY
-  // Push telemetry once for all changes (with debouncing)
-  if (anyChanged && telemetryEnabled) {
+  // Push telemetry once per flush (with debouncing)
+  if (telemetryEnabled) {
     unsigned long now = millis();
     if (now - lastStateTelemetryPush >= STATE_TELEMETRY_MIN_INTERVAL) {
-      TELEM_LOG("State change push (batch)");
+      TELEM_LOG("State change push");
       if (gatewayMode) {
         pushTelemetry();
       } else {
@@ -277,157 +623,900 @@ bool MeshSwarm::setStates(std::initializer_list<std::pair<String, String>> state
       lastTelemetryPush = now;
       lastStateTelemetryPush = now;
     } else {
-      TELEM_LOG_D("Debounced batch (wait %lums)",
+      TELEM_LOG_D("Debounced state push (wait %lums)",
                   STATE_TELEMETRY_MIN_INTERVAL - (now - lastStateTelemetryPush));
     }
   }
 #endif
+}
 
-  return anyChanged;
+// Lookup for the getters: marks the entry as used for LRU eviction and hides
+// entries whose TTL ran out but that the next sweep has not removed yet
+const StateEntry* MeshSwarm::readState(const String& key) {
+  StateEntry* entry = sharedState.find(key);
+  if (!entry) return nullptr;
+
+  unsigned long now = millis();
+  if (stateExpired(*entry, now)) return nullptr;
+  entry->lastUsed = now;
+  return entry;
 }
 
 String MeshSwarm::getState(const String& key, const String& defaultVal) {
-  if (sharedState.count(key)) {
-    return sharedState[key].value;
+  MESHSWARM_LOCK();
+  const StateEntry* entry = readState(key);
+  if (entry) {
+    return String(entry->value());
   }
   return defaultVal;
 }
 
-void MeshSwarm::watchState(const String& key, StateCallback callback) {
-  stateWatchers[key].push_back(callback);
+// Typed getters read numbers natively and fall back to parsing the text of
+// string entries (e.g. written by a node running older firmware)
+int32_t MeshSwarm::getStateInt(const String& key, int32_t defaultVal) {
+  MESHSWARM_LOCK();
+  const StateEntry* entry = readState(key);
+  if (!entry) return defaultVal;
+
+  StateValue parsed;
+  switch (entry->type()) {
+    case STATE_TYPE_INT:
+    case STATE_TYPE_BOOL:
+      return entry->intValue();
+    case STATE_TYPE_FLOAT:
+      return (int32_t)entry->floatValue();
+    default:
+      if (StateValue::parse(STATE_TYPE_INT, entry->value(), entry->valueLength(), &parsed)) {
+        return parsed.num.i;
+      }
+      if (StateValue::parse(STATE_TYPE_FLOAT, entry->value(), entry->valueLength(), &parsed)) {
+        return (int32_t)parsed.num.f;
+      }
+      return defaultVal;
+  }
+}
+
+float MeshSwarm::getStateFloat(const String& key, float defaultVal) {
+  MESHSWARM_LOCK();
+  const StateEntry* entry = readState(key);
+  if (!entry) return defaultVal;
+
+  StateValue parsed;
+  switch (entry->type()) {
+    case STATE_TYPE_FLOAT:
+      return entry->floatValue();
+    case STATE_TYPE_INT:
+    case STATE_TYPE_BOOL:
+      return (float)entry->intValue();
+    default:
+      if (StateValue::parse(STATE_TYPE_FLOAT, entry->value(), entry->valueLength(), &parsed)) {
+        return parsed.num.f;
+      }
+      return defaultVal;
+  }
+}
+
+bool MeshSwarm::getStateBool(const String& key, bool defaultVal) {
+  MESHSWARM_LOCK();
+  const StateEntry* entry = readState(key);
+  if (!entry) return defaultVal;
+
+  StateValue parsed;
+  switch (entry->type()) {
+    case STATE_TYPE_INT:
+    case STATE_TYPE_BOOL:
+      return entry->intValue() != 0;
+    case STATE_TYPE_FLOAT:
+      return entry->floatValue() != 0;
+    default:
+      if (StateValue::parse(STATE_TYPE_BOOL, entry->value(), entry->valueLength(), &parsed)) {
+        return parsed.num.i != 0;
+      }
+      return defaultVal;
+  }
+}
+
+int MeshSwarm::getStateBytes(const String& key, uint8_t* buffer, size_t maxLen) {
+  MESHSWARM_LOCK();
+  const StateEntry* entry = readState(key);
+  if (!entry || entry->type() != STATE_TYPE_BYTES) return -1;
+
+  size_t len = entry->valueLength();
+  const char* text = entry->value();
+  size_t decoded = len / 4 * 3;
+  if (len > 0 && text[len - 1] == '=') decoded--;
+  if (len > 1 && text[len - 2] == '=') decoded--;
+  if (decoded > maxLen) return -1;
+  return StateStore::base64Decode(text, len, buffer);
+}
+
+StateType MeshSwarm::getStateType(const String& key) {
+  MESHSWARM_LOCK();
+  const StateEntry* entry = readState(key);
+  return entry ? entry->type() : STATE_TYPE_STRING;
+}
+
+// ============== WATCHERS ==============
+
+// Orders a watcher pattern against the first len bytes of a key
+static int comparePattern(const String& pattern, const char* key, size_t len) {
+  int r = strncmp(pattern.c_str(), key, len);
+  if (r != 0) return r;
+  return pattern.length() > len ? 1 : 0;
+}
+
+// First watcher whose pattern equals key[0, len)
+static size_t findWatcher(const std::vector<StateWatcher>& list, const char* key, size_t len) {
+  size_t lo = 0, hi = list.size();
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (comparePattern(list[mid].pattern, key, len) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// Inserted after watchers with the same pattern, so they run in
+// registration order
+static void insertWatcher(std::vector<StateWatcher>& list, const String& pattern,
+                          StateCallback callback) {
+  size_t pos = findWatcher(list, pattern.c_str(), pattern.length());
+  while (pos < list.size() && list[pos].pattern == pattern) pos++;
+  list.insert(list.begin() + pos, StateWatcher{pattern, callback});
+}
+
+// '*' matches any run of characters (including '/'), '?' any one character
+static bool globMatch(const char* pattern, const char* str) {
+  const char* star = nullptr;
+  const char* resume = nullptr;
+  while (*str) {
+    if (*pattern == '?' || (*pattern != '*' && *pattern == *str)) {
+      pattern++;
+      str++;
+    } else if (*pattern == '*') {
+      star = pattern++;
+      resume = str;
+    } else if (star) {
+      pattern = star + 1;
+      str = ++resume;
+    } else {
+      return false;
+    }
+  }
+  while (*pattern == '*') pattern++;
+  return *pattern == 0;
+}
+
+void MeshSwarm::watchState(const String& pattern, StateCallback callback) {
+  MESHSWARM_LOCK();
+  int wildcard = -1;
+  for (unsigned int i = 0; i < pattern.length(); i++) {
+    if (pattern[i] == '*' || pattern[i] == '?') {
+      wildcard = i;
+      break;
+    }
+  }
+
+  if (wildcard < 0) {
+    insertWatcher(exactWatchers, pattern, callback);
+    addInterest(pattern);
+    return;
+  }
+
+  // Keys of interest for partial replication: the literal part up front
+  String prefix = pattern.substring(0, wildcard);
+  if (wildcard == (int)pattern.length() - 1 && pattern[wildcard] == '*') {
+    insertWatcher(prefixWatchers, prefix, callback);
+    uint16_t len = prefix.length();
+    auto it = std::lower_bound(prefixLengths.begin(), prefixLengths.end(), len);
+    if (it == prefixLengths.end() || *it != len) {
+      prefixLengths.insert(it, len);
+    }
+  } else {
+    globWatchers.push_back(StateWatcher{pattern, callback});
+  }
+  addInterest(prefix);
+}
+
+void MeshSwarm::setDeferredWatchers(bool enable) {
+#if MESHSWARM_ENABLE_THREADED
+  // Watchers must not run on the mesh task
+  enable = true;
+#endif
+  {
+    MESHSWARM_LOCK();
+    deferredWatchers = enable;
+  }
+  if (!enable) {
+    // Nothing queued may be lost or overtaken by synchronous dispatch
+    while (watchQueueHead < watchQueue.size()) {
+      dispatchWatchers();
+    }
+  }
 }
 
 void MeshSwarm::triggerWatchers(const String& key, const String& value, const String& oldValue) {
-  if (stateWatchers.count(key)) {
-    for (auto& cb : stateWatchers[key]) {
-      cb(key, value, oldValue);
+  stateVersion++;
+  if (exactWatchers.empty() && prefixWatchers.empty() && globWatchers.empty()) return;
+
+  if (!deferredWatchers) {
+    runWatchers(key, value, oldValue);
+    return;
+  }
+
+  // Coalesce with a change to the same key that is still queued
+  uint32_t hash = StateStore::hashKey(key.c_str(), key.length());
+  for (size_t i = watchQueueHead; i < watchQueue.size(); i++) {
+    WatchEvent& ev = watchQueue[i];
+    if (ev.keyHash == hash && ev.key == key) {
+      ev.value = value;
+      return;
+    }
+  }
+  watchQueue.push_back(WatchEvent{hash, key, value, oldValue});
+}
+
+// Exact watchers first, then prefixes from longest to shortest ("*" last),
+// then globs. Lists are walked by index: a callback may add watchers.
+void MeshSwarm::runWatchers(const String& key, const String& value, const String& oldValue) {
+  const char* k = key.c_str();
+  size_t len = key.length();
+
+  for (size_t i = findWatcher(exactWatchers, k, len);
+       i < exactWatchers.size() && comparePattern(exactWatchers[i].pattern, k, len) == 0; i++) {
+    exactWatchers[i].callback(key, value, oldValue);
+  }
+
+  for (size_t n = prefixLengths.size(); n-- > 0;) {
+    size_t plen = prefixLengths[n];
+    if (plen > len) continue;
+    for (size_t i = findWatcher(prefixWatchers, k, plen);
+         i < prefixWatchers.size() && comparePattern(prefixWatchers[i].pattern, k, plen) == 0; i++) {
+      prefixWatchers[i].callback(key, value, oldValue);
     }
   }
 
-  // Wildcard watchers
-  if (stateWatchers.count("*")) {
-    for (auto& cb : stateWatchers["*"]) {
-      cb(key, value, oldValue);
+  for (size_t i = 0; i < globWatchers.size(); i++) {
+    if (globMatch(globWatchers[i].pattern.c_str(), k)) {
+      globWatchers[i].callback(key, value, oldValue);
     }
   }
 }
 
-void MeshSwarm::broadcastState(const String& key) {
-  if (!sharedState.count(key)) return;
+// Runs queued changes until the queue is empty or WATCH_DISPATCH_BUDGET_US
+// is used up (at least one per call). Changes that ended where they started
+// are dropped.
+// Callbacks run without the mesh lock; only the queue is shared.
+void MeshSwarm::dispatchWatchers() {
+  unsigned long start = micros();
+  for (;;) {
+    WatchEvent ev;
+    {
+      MESHSWARM_LOCK();
+      if (watchQueueHead >= watchQueue.size()) break;
+      ev = std::move(watchQueue[watchQueueHead++]);
+      if (watchQueueHead >= watchQueue.size()) {
+        // Capacity is kept so steady-state queuing does not reallocate
+        watchQueue.clear();
+        watchQueueHead = 0;
+      }
+    }
+    if (ev.value != ev.oldValue) {
+      runWatchers(ev.key, ev.value, ev.oldValue);
+    }
+    if (micros() - start >= WATCH_DISPATCH_BUDGET_US) break;
+  }
+}
+
+// ============== PARTIAL REPLICATION ==============
+void MeshSwarm::setPartialReplica(bool enable) {
+  MESHSWARM_LOCK();
+  partialReplica = enable;
+  updateReplicaMode();
+}
+
+void MeshSwarm::subscribe(const String& prefix) {
+  MESHSWARM_LOCK();
+  addInterest(prefix == "*" ? String() : prefix);
+  setPartialReplica(true);
+}
+
+void MeshSwarm::addInterest(const String& prefix) {
+  for (const String& p : interestPrefixes) {
+    if (p == prefix) return;
+  }
+  interestPrefixes.push_back(prefix);
+  if (!fullReplica) {
+    // The digest covers exactly the keys of interest
+    updateReplicaMode();
+#if MESHSWARM_ENABLE_DIGEST_SYNC
+    digestValid = false;
+#endif
+  }
+}
 
-  StateEntry& entry = sharedState[key];
+static bool matchesInterest(const char* key, size_t len, const std::vector<String>& prefixes) {
+  for (const String& p : prefixes) {
+    if (p.length() <= len && memcmp(key, p.c_str(), p.length()) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
 
-  JsonDocument data;
-  data["k"] = key;
-  data["v"] = entry.value;
-  data["ver"] = entry.version;
-  data["org"] = entry.origin;
+bool MeshSwarm::isInterested(const char* key, size_t len) {
+  return fullReplica || matchesInterest(key, len, interestPrefixes);
+}
 
-  String msg = createMsg(MSG_STATE_SET, data);
-  mesh.sendBroadcast(msg);
+// Interest of a partial replica peer, nullptr if it stores everything (or
+// has not sent a heartbeat yet)
+const std::vector<String>* MeshSwarm::peerInterest(uint32_t nodeId) {
+  auto it = peers.find(nodeId);
+  if (it == peers.end() || !it->second.partial) return nullptr;
+  return &it->second.interest;
+}
+
+// Heartbeats repeat the interest every time; only copied when it changes
+void MeshSwarm::updatePeerInterest(Peer& peer, JsonArray interest) {
+  peer.partial = !interest.isNull();
+  bool same = peer.interest.size() == (peer.partial ? interest.size() : 0);
+  size_t i = 0;
+  for (JsonVariant v : interest) {
+    if (!same) break;
+    same = peer.interest[i++] == (v | "");
+  }
+  if (same) return;
+
+  peer.interest.clear();
+  for (JsonVariant v : interest) {
+    peer.interest.push_back(v | "");
+  }
+}
+
+// Partial replication is dropped while this node is coordinator or gateway
+// (or watches "*"), so there is always a full copy to sync from
+void MeshSwarm::updateReplicaMode() {
+  bool full = !partialReplica || coordinatorId == myId;
+#if MESHSWARM_ENABLE_TELEMETRY
+  full = full || gatewayMode;
+#endif
+  for (const String& p : interestPrefixes) {
+    if (p.length() == 0) full = true;
+  }
+  if (full == fullReplica) return;
+
+  fullReplica = full;
+#if MESHSWARM_ENABLE_DIGEST_SYNC
+  digestValid = false;
+#endif
+  if (!full) {
+    dropUninterestedState();
+  }
+  STATE_LOG("Replica: %s (%d keys)", full ? "full" : "partial", sharedState.size());
+}
+
+// Frees replicated keys outside the interest. No tombstone is left: the
+// keys were not removed mesh-wide and may be wanted again as full replica.
+void MeshSwarm::dropUninterestedState() {
+  for (size_t i = sharedState.size(); i-- > 0;) {
+    StateEntry& e = sharedState.begin()[i];
+    if (e.origin == myId || e.pending) continue;
+    if (matchesInterest(e.key(), e.keyLength(), interestPrefixes)) continue;
+    sharedState.drop(&e);
+    stateVersion++;
+  }
+}
+
+void MeshSwarm::broadcastState(const StateEntry& entry) {
+  JsonDocument data(&msgArena);
+  JsonObject obj = data.to<JsonObject>();
+  StateType implied = writeStateKey(obj, entry);
+  writeStateValue(obj, entry, implied);
+  obj["ver"] = entry.version;
+  obj["org"] = entry.origin;
+  writeStateTtl(obj, entry, millis());
+
+  const String& msg = createMsg(MSG_STATE_SET, data);
+  sendMsg(TX_STATE, 0, msg);
 }
 
 void MeshSwarm::broadcastFullState() {
+  MESHSWARM_LOCK();
+  sendStateEntries(0);
+}
+
+// Typed values go out as native JSON numbers/bools once every node has
+// CAP_TYPED_STATE, as text otherwise. "vt" is added for every value sent
+// as text whose type is not the implied one (string, or the declared type
+// of a key sent by schema id), and for floats (JSON cannot tell 21.0 from
+// 21), so types survive mixed-version meshes.
+void MeshSwarm::writeStateValue(JsonObject& obj, const StateEntry& entry, StateType implied) {
+  StateType type = entry.type();
+  if (meshCaps & CAP_TYPED_STATE) {
+    switch (type) {
+      case STATE_TYPE_INT:
+        obj["v"] = entry.intValue();
+        if (implied == STATE_TYPE_FLOAT) obj["vt"] = (int)type;
+        return;
+      case STATE_TYPE_BOOL:
+        obj["v"] = entry.intValue() != 0;
+        return;
+      case STATE_TYPE_FLOAT:
+        obj["v"] = entry.floatValue();
+        if (implied != STATE_TYPE_FLOAT) obj["vt"] = (int)type;
+        return;
+      default:
+        break;
+    }
+  }
+  obj["v"] = entry.value();
+  if (type != implied) {
+    obj["vt"] = (int)type;
+  }
+}
+
+// TTLs travel as the time left rather than a deadline, since nodes do not
+// share a clock; each receiver restarts the countdown on arrival
+void MeshSwarm::writeStateTtl(JsonObject& obj, const StateEntry& entry, unsigned long now) {
+  if (entry.expiresAt != 0) {
+    obj["ttl"] = (uint32_t)(entry.expiresAt - now);
+  }
+}
+
+// Inverse of writeStateValue(); false for values of an unknown type
+bool MeshSwarm::readStateValue(JsonObject& obj, StateValue* value, StateType declared) {
+  JsonVariant v = obj["v"];
+  StateType type = (StateType)(obj["vt"] | (int)declared);
+
+  if (v.is<bool>()) {
+    *value = StateValue::fromBool(v.as<bool>());
+    return true;
+  }
+  if (v.is<const char*>() || v.isNull()) {
+    const char* text = v | "";
+    return StateValue::parse(type, text, strlen(text), value);
+  }
+  if (type != STATE_TYPE_FLOAT && v.is<int32_t>()) {
+    *value = StateValue::fromInt(v.as<int32_t>());
+    return true;
+  }
+  if (v.is<float>()) {
+    *value = StateValue::fromFloat(v.as<float>());
+    return true;
+  }
+  return false;
+}
+
+// Upper bound of the JSON size of one sync entry:
+// {"k":"","v":"","vt":N,"ver":N,"org":N,"ttl":N},
+static size_t stateEntryCost(const StateEntry& entry) {
+  size_t cost = 42 + entry.keyLength() + entry.valueLength();
+  if (entry.type() != STATE_TYPE_STRING) cost += 7;
+  if (entry.expiresAt != 0) cost += 17;
+  return cost;
+}
+
+// Sends state entries split into frames of at most STATE_SYNC_CHUNK_BYTES,
+// each tagged with "seq"/"tot" so peak heap stays flat however large the
+// state map grows. dest 0 broadcasts; bucketMask limits the digest buckets
+// and pendingOnly limits it to entries queued by flushPendingState().
+void MeshSwarm::sendStateEntries(uint32_t dest, const bool* bucketMask, bool pendingOnly,
+                                 const std::vector<String>* interest) {
   if (sharedState.empty()) return;
 
-  JsonDocument data;
-  JsonArray arr = data["s"].to<JsonArray>();
+  // First pass: count frames with the same packing rule as the second
+  unsigned long now = millis();
+  int total = 0;
+  size_t used = 0;
+  for (const StateEntry& e : sharedState) {
+    if (pendingOnly && !e.pending) continue;
+    if (stateExpired(e, now)) continue;
+    if (interest && !matchesInterest(e.key(), e.keyLength(), *interest)) continue;
+#if MESHSWARM_ENABLE_DIGEST_SYNC
+    if (bucketMask && !bucketMask[stateBucket(e)]) continue;
+#endif
+    size_t cost = stateEntryCost(e);
+    if (total == 0 || used + cost > STATE_SYNC_CHUNK_BYTES) {
+      total++;
+      used = 0;
+    }
+    used += cost;
+  }
+  if (total == 0) return;
+
+  const StateEntry* it = sharedState.begin();
+  for (int seq = 0; seq < total; seq++) {
+    JsonDocument data(&msgArena);
+    JsonArray arr = data["s"].to<JsonArray>();
+    used = 0;
+
+    for (; it != sharedState.end(); ++it) {
+      if (pendingOnly && !it->pending) continue;
+      if (stateExpired(*it, now)) continue;
+      if (interest && !matchesInterest(it->key(), it->keyLength(), *interest)) continue;
+#if MESHSWARM_ENABLE_DIGEST_SYNC
+      if (bucketMask && !bucketMask[stateBucket(*it)]) continue;
+#endif
+      size_t cost = stateEntryCost(*it);
+      if (arr.size() > 0 && used + cost > STATE_SYNC_CHUNK_BYTES) break;
+
+      JsonObject entry = arr.add<JsonObject>();
+      StateType implied = writeStateKey(entry, *it);
+      writeStateValue(entry, *it, implied);
+      entry["ver"] = it->version;
+      entry["org"] = it->origin;
+      writeStateTtl(entry, *it, now);
+      used += cost;
+    }
 
-  for (auto& kv : sharedState) {
-    JsonObject entry = arr.add<JsonObject>();
-    entry["k"] = kv.first;
-    entry["v"] = kv.second.value;
-    entry["ver"] = kv.second.version;
-    entry["org"] = kv.second.origin;
+    if (total > 1) {
+      data["seq"] = seq;
+      data["tot"] = total;
+    }
+
+    // Flushed local changes are state sets sent in bulk; anything else is
+    // a repair, which a full receiver may decline (see handleStateSet)
+    if (!pendingOnly) {
+      data["rp"] = 1;
+    }
+    const String& msg = createMsg(MSG_STATE_SYNC, data);
+    sendMsg(pendingOnly ? TX_STATE : TX_SYNC, dest, msg);
   }
 
-  String msg = createMsg(MSG_STATE_SYNC, data);
-  mesh.sendBroadcast(msg);
+  STATE_LOG_D("Sync: sent %d frame(s) to %s", total,
+              dest == 0 ? "all" : nodeIdToName(dest).c_str());
 }
 
 void MeshSwarm::requestStateSync() {
-  JsonDocument data;
+  MESHSWARM_LOCK();
+  JsonDocument data(&msgArena);
   data["req"] = 1;
-  String msg = createMsg(MSG_STATE_REQ, data);
-  mesh.sendBroadcast(msg);
+  uint32_t responder = selectSyncResponder();
+  if (responder) {
+    data["to"] = responder;
+  }
+  const String& msg = createMsg(MSG_STATE_REQ, data);
+  sendMsg(TX_STATE, 0, msg);
 }
 
-void MeshSwarm::handleStateSet(uint32_t from, JsonObject& data) {
-  String key = data["k"] | "";
-  String value = data["v"] | "";
+// One responder per MSG_STATE_REQ instead of one per node: the node the
+// requester picked (or, if it named none, the coordinator) answers straight
+// away, other full replicas only after a random back-off in case that node
+// is gone or runs older firmware
+void MeshSwarm::handleStateRequest(uint32_t from, JsonObject& data) {
+  uint32_t to = data["to"] | 0u;
+  if (to == myId || (to == 0 && coordinatorId == myId)) {
+    answerStateRequest(from);
+    return;
+  }
+  if (!fullReplica || pendingSyncReplies.count(from)) return;
+
+  pendingSyncReplies[from] = millis() + random(STATE_REQ_BACKOFF_MIN, STATE_REQ_BACKOFF_MAX);
+}
+
+void MeshSwarm::answerStateRequest(uint32_t requester) {
+  pendingSyncReplies.erase(requester);
+
+  JsonDocument claim(&msgArena);
+  claim["req"] = requester;
+  const String& msg = createMsg(MSG_SYNC_CLAIM, claim);
+  sendMsg(TX_STATE, 0, msg);
+
+#if MESHSWARM_ENABLE_DIGEST_SYNC
+  // Digest-capable requesters get our bucket hashes and pull the difference
+  if (peers.count(requester) && (peers[requester].caps & CAP_DIGEST_SYNC)) {
+    sendDigestBuckets(requester, false, peerInterest(requester));
+    return;
+  }
+#endif
+  sendStateEntries(requester, nullptr, false, peerInterest(requester));
+}
+
+void MeshSwarm::processSyncReplies(unsigned long now) {
+  for (auto it = pendingSyncReplies.begin(); it != pendingSyncReplies.end();) {
+    if ((long)(now - it->second) >= 0) {
+      uint32_t requester = it->first;
+      it = pendingSyncReplies.erase(it);
+      STATE_LOG_D("No reply overheard, answering %s", nodeIdToName(requester).c_str());
+      answerStateRequest(requester);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void MeshSwarm::handleStateSet(uint32_t from, JsonObject& data, bool repair) {
+  StateType declared;
+  const char* key = readStateKey(data, &declared);
   uint32_t version = data["ver"] | 0;
   uint32_t origin = data["org"] | from;
 
-  if (key.length() == 0) return;
+  size_t keyLen = strlen(key);
+  if (keyLen == 0) return;
 
-  bool shouldUpdate = false;
-  String oldValue = "";
+  // Partial replicas keep keys of interest plus keys they already hold
+  if (!isInterested(key, keyLen) && !sharedState.find(key, keyLen)) {
+    stateStats.filtered++;
+    return;
+  }
 
-  if (!sharedState.count(key)) {
-    shouldUpdate = true;
-  } else {
-    StateEntry& existing = sharedState[key];
-    oldValue = existing.value;
+  StateValue value;
+  if (!readStateValue(data, &value, declared)) {
+    STATE_LOG("Ignoring %s: unsupported value from %s", key, nodeIdToName(from).c_str());
+    return;
+  }
 
-    if (version > existing.version) {
-      shouldUpdate = true;
-    } else if (version == existing.version && origin < existing.origin) {
-      shouldUpdate = true;
+  // A removed key only comes back with a newer write than the removal, so a
+  // replica still holding the old copy cannot resurrect it through sync
+  if (!sharedState.tombstones().empty() && !sharedState.find(key, keyLen)) {
+    const StateTombstone* tomb = sharedState.findTombstone(key, keyLen);
+    if (tomb && tomb->covers(version, origin)) {
+      stateStats.rejected++;
+      return;
     }
   }
 
-  if (shouldUpdate && oldValue != value) {
-    StateEntry entry;
-    entry.value = value;
-    entry.version = version;
-    entry.origin = origin;
-    entry.timestamp = millis();
-    sharedState[key] = entry;
+  // A full store takes a repaired key it does not hold only if it fits:
+  // evicting for it would leave a gap the next repair fills again
+  if (repair && origin != myId && !sharedState.fits(keyLen, value.length()) &&
+      !sharedState.find(key, keyLen)) {
+    stateStats.declined++;
+    return;
+  }
 
-    triggerWatchers(key, value, oldValue);
-#if MESHSWARM_ENABLE_DISPLAY
-    lastStateChange = key + "=" + value;
+  bool created;
+  StateEntry* entry = sharedState.findOrCreate(key, keyLen, &created);
+  if (!entry) {
+    STATE_LOG("Out of memory storing %s", key);
+    return;
+  }
+  if (created) {
+    registerStateKey(entry);
+  }
+
+  unsigned long now = millis();
+  uint32_t ttl = data["ttl"] | 0;
+  String oldValue;
+  if (!created) {
+    bool newer = version > entry->version ||
+                 (version == entry->version && origin < entry->origin);
+    if (!newer) return;
+
+    if (entry->equals(value)) {
+      // Same value under newer metadata: adopt version/origin silently so
+      // every replica ends up with identical entries (and digests)
+      entry->version = version;
+      entry->origin = origin;
+      entry->expiresAt = ttl ? stateDeadline(now, ttl) : 0;
+#if MESHSWARM_ENABLE_DIGEST_SYNC
+      digestValid = false;
 #endif
+      return;
+    }
+    oldValue = entry->value();
+  } else if (!sharedState.tombstones().empty()) {
+    sharedState.clearTombstone(key, keyLen);
+  }
 
-    STATE_LOG("%s = %s (v%u from %s)",
-              key.c_str(), value.c_str(), version, nodeIdToName(origin).c_str());
+  if (!sharedState.setValue(entry, value)) {
+    STATE_LOG("Out of memory storing %s", key);
+    return;
   }
+  entry->version = version;
+  entry->origin = origin;
+  entry->timestamp = now;
+  entry->lastUsed = now;
+  entry->expiresAt = ttl ? stateDeadline(now, ttl) : 0;
+#if MESHSWARM_ENABLE_DIGEST_SYNC
+  digestValid = false;
+#endif
+
+  String keyStr(key);
+  String valueStr(entry->value());
+  triggerWatchers(keyStr, valueStr, oldValue);
+#if MESHSWARM_ENABLE_DISPLAY
+  noteStateChange(key, valueStr.c_str());
+#endif
+
+  STATE_LOG("%s = %s (v%u from %s)",
+            key, valueStr.c_str(), version, nodeIdToName(origin).c_str());
+  enforceStateBudget();
 }
 
 void MeshSwarm::handleStateSync(uint32_t from, JsonObject& data) {
   JsonArray arr = data["s"].as<JsonArray>();
+  bool repair = data["rp"] | 0;
 
+#if MESHSWARM_ENABLE_DIGEST_SYNC
+  uint32_t before = repair ? getStateDigest() : 0;
+#endif
   for (JsonObject entry : arr) {
-    handleStateSet(from, entry);
+    handleStateSet(from, entry, repair);
   }
+#if MESHSWARM_ENABLE_DIGEST_SYNC
+  if (repair) {
+    noteRepairResult(from, before);
+  }
+#endif
 
-  STATE_LOG_D("Received %d state entries from %s",
-              arr.size(), nodeIdToName(from).c_str());
+  // Chunks are applied independently as they arrive; seq/tot are informational
+  STATE_LOG_D("Received %d state entries from %s (%d/%d)",
+              arr.size(), nodeIdToName(from).c_str(),
+              (int)(data["seq"] | 0) + 1, (int)(data["tot"] | 1));
 }
 
-// ============== MESH CALLBACKS ==============
-void MeshSwarm::onReceive(uint32_t from, String &msg) {
-  JsonDocument doc;
-  DeserializationError err = deserializeJson(doc, msg);
+// Removes entries whose TTL ran out. Every replica counts down on its own,
+// so nothing is sent; watchers see the key change to an empty value.
+void MeshSwarm::expireState() {
+  unsigned long now = millis();
+  std::vector<std::pair<String, String>> expired;
 
-  if (err) {
-    MESH_LOG_ERROR("JSON error from %u", from);
-    return;
+  for (size_t i = sharedState.size(); i-- > 0;) {
+    StateEntry& e = sharedState.begin()[i];
+    if (!stateExpired(e, now)) continue;
+
+    if (e.pending && pendingStateCount > 0) {
+      pendingStateCount--;
+    }
+    expired.emplace_back(String(e.key()), String(e.value()));
+    sharedState.remove(&e, stateDeadline(now, STATE_TOMBSTONE_TTL));
+    stateStats.expired++;
+  }
+
+  bool pruned = sharedState.pruneTombstones(now);
+#if MESHSWARM_ENABLE_DIGEST_SYNC
+  if (pruned || !expired.empty()) {
+    digestValid = false;
   }
+#else
+  (void)pruned;
+#endif
+#if MESHSWARM_ENABLE_DISPLAY
+  if (!expired.empty()) {
+    displayDirty = true;
+  }
+#endif
+
+  for (auto& kv : expired) {
+    STATE_LOG_D("%s expired", kv.first.c_str());
+    triggerWatchers(kv.first, String(), kv.second);
+  }
+}
 
-  MsgType type = (MsgType)doc["t"].as<int>();
-  String senderName = doc["n"] | "???";
-  JsonObject data = doc["d"].as<JsonObject>();
+// Evicts replicated entries until the store is back under its entry/byte
+// limits. Entries written here are never evicted, so a node that owns more
+// than the budget keeps growing (and logs it on each write).
+void MeshSwarm::enforceStateBudget() {
+  while (sharedState.overBudget()) {
+    StateEntry* victim = sharedState.evictionCandidate(myId);
+    if (!victim) {
+      STATE_LOG("Over budget with %d entries (%u bytes), nothing to evict",
+                sharedState.size(), (unsigned)sharedState.dataBytes());
+      return;
+    }
+    STATE_LOG_D("Evicting %s", victim->key());
+    sharedState.remove(victim, stateDeadline(millis(), STATE_TOMBSTONE_TTL));
+    stateStats.evicted++;
+    stateVersion++;
+#if MESHSWARM_ENABLE_DIGEST_SYNC
+    digestValid = false;
+#endif
+#if MESHSWARM_ENABLE_DISPLAY
+    displayDirty = true;
+#endif
+  }
+}
+
+// ============== MESH CALLBACKS ==============
+void MeshSwarm::onReceive(uint32_t from, String &msg) {
+  MESHSWARM_PERF_SCOPE(PERF_RECEIVE);
+#if MESHSWARM_ENABLE_TX_SCHEDULER
+  noteAirtime(msg.length());
+#endif
+  // Parsed into the message arena; strings are read in place from doc
+  JsonDocument doc(&msgArena);
+  MsgType type;
+  const char* senderName;
+  JsonObject data;
+
+#if MESHSWARM_ENABLE_BINARY_WIRE
+  if (msg.length() > 0 && msg[0] == BINARY_WIRE_MARKER) {
+    // Binary envelope: [type, data] or [type, data, name] for heartbeats
+    DeserializationError err = decodeBinaryMsg(msg, doc);
+    if (err) {
+      MESH_LOG_ERROR("Binary frame error from %u", from);
+      MESHSWARM_PERF_COUNT(binaryErrors);
+      return;
+    }
+    type = (MsgType)doc[0].as<int>();
+    data = doc[1].as<JsonObject>();
+    senderName = doc[2] | "???";
+  } else
+#endif
+  {
+    DeserializationError err = deserializeJson(doc, msg);
+    if (err) {
+      MESH_LOG_ERROR("JSON error from %u", from);
+      MESHSWARM_PERF_COUNT(jsonErrors);
+      return;
+    }
+    type = (MsgType)doc["t"].as<int>();
+    senderName = doc["n"] | "???";
+    data = doc["d"].as<JsonObject>();
+  }
+  MESHSWARM_PERF_RX(type, msg.length());
+
+  // Any frame shows the sender is alive (adaptive heartbeats are skipped
+  // while other traffic goes out); one that timed out while still in the
+  // node list comes back with it too
+  if (type != MSG_HEARTBEAT) {
+    auto it = peers.find(from);
+    if (it != peers.end() && (it->second.alive || isKnownNode(from))) {
+      it->second.lastSeen = millis();
+      setPeerAlive(it->second, true);
+    }
+  }
 
   switch (type) {
     case MSG_HEARTBEAT: {
+      // Delta beats ("dt") leave out unchanged fields, so one from a peer
+      // with no entry says too little (a missing "cap" would read as a
+      // legacy node); it is dropped and our next beat asks for a full one
+      bool full = !(data["dt"] | 0);
+      if (!full && peers.find(from) == peers.end()) {
+#if MESHSWARM_ENABLE_ADAPTIVE_HEARTBEAT
+        heartbeatAsk = true;
+#endif
+        break;
+      }
       Peer &p = peers[from];
+      bool isNew = p.id != from;
+      uint8_t caps = data["cap"] | (full ? 0 : p.caps);
+      bool capsChanged = isNew || (p.caps != caps);
       p.id = from;
-      p.name = senderName;
-      p.role = data["role"] | "PEER";
+      // Only copied when they change, so steady-state heartbeats don't allocate
+      const char* role = data["role"] | (full ? "PEER" : p.role.c_str());
+      if (p.name != senderName) p.name = senderName;
+      if (p.role != role) p.role = role;
+      p.caps = caps;
+#if MESHSWARM_ENABLE_KEY_SCHEMA
+      uint32_t schema = data["ks"] | (full ? 0u : p.keySchema);
+      if (schema != p.keySchema) {
+        p.keySchema = schema;
+        capsChanged = true;
+      }
+#endif
+      if (full || !data["int"].isNull()) {
+        updatePeerInterest(p, data["int"].as<JsonArray>());
+      }
+      p.interval = data["hi"] | (full ? (uint32_t)HEARTBEAT_INTERVAL : p.interval);
+      p.states = data["states"] | (full ? 0 : p.states);
+      notePeerSequence(p, data["sq"] | 0);
+#if MESHSWARM_ENABLE_ADAPTIVE_HEARTBEAT
+      // The sender has not heard from every node yet (their beats may all
+      // have been lost or skipped), so the next beat is full and is sent
+      if (data["ask"] | 0) {
+        heartbeatFull = true;
+      }
+#endif
       p.lastSeen = millis();
-      p.alive = true;
-      electCoordinator();
+      setPeerAlive(p, true);
+      if (isNew) {
+        peerHopsDirty = true;
+      }
+      // The topology callbacks keep the node list current; a sender missing
+      // from it means one was missed, so resync instead of electing per beat
+      if (!isKnownNode(from)) {
+        refreshNodeList();
+        electCoordinator();
+        capsChanged = true;
+      }
+      if (capsChanged) {
+        updateMeshCapabilities();
+      }
       break;
     }
 
@@ -440,9 +1529,20 @@ void MeshSwarm::onReceive(uint32_t from, String &msg) {
       break;
 
     case MSG_STATE_REQ:
-      broadcastFullState();
+      handleStateRequest(from, data);
+      break;
+
+    case MSG_SYNC_CLAIM:
+      // Someone else is answering; drop our delayed reply
+      pendingSyncReplies.erase(data["req"] | 0u);
       break;
 
+#if MESHSWARM_ENABLE_DIGEST_SYNC
+    case MSG_STATE_DIGEST:
+      handleStateDigest(from, data);
+      break;
+#endif
+
     case MSG_COMMAND:
       break;
 
@@ -462,62 +1562,204 @@ void MeshSwarm::onReceive(uint32_t from, String &msg) {
 
 void MeshSwarm::onNewConnection(uint32_t nodeId) {
   MESH_LOG("+ Connected: %s", nodeIdToName(nodeId).c_str());
+  // The new node's capabilities are unknown until its first heartbeat
+  meshCaps = 0;
+#if MESHSWARM_ENABLE_KEY_SCHEMA
+  keySchemaShared = false;
+#endif
+  resetHeartbeat();
   sendHeartbeat();
+#if MESHSWARM_ENABLE_DIGEST_SYNC
+  // Sync once heartbeats have been exchanged, so a digest-capable newcomer
+  // is reconciled by digest instead of a full-state broadcast
+  lastStateSync = millis() - STATE_SYNC_INTERVAL + STATE_JOIN_SYNC_DELAY;
+#else
   broadcastFullState();
+#endif
 }
 
 void MeshSwarm::onDroppedConnection(uint32_t nodeId) {
   MESH_LOG("- Dropped: %s", nodeIdToName(nodeId).c_str());
-  if (peers.count(nodeId)) {
-    peers[nodeId].alive = false;
+  auto it = peers.find(nodeId);
+  if (it != peers.end()) {
+    setPeerAlive(it->second, false);
   }
+  resetHeartbeat();
+  refreshNodeList();
+  markUnreachablePeers();
   electCoordinator();
+  updateMeshCapabilities();
 }
 
 void MeshSwarm::onChangedConnections() {
-  MESH_LOG("Topology changed. Nodes: %d", mesh.getNodeList().size());
+  refreshNodeList();
+  MESH_LOG("Topology changed. Nodes: %d", (int)meshNodes.size());
+  markUnreachablePeers();
+  resetHeartbeat();
   electCoordinator();
+  updateMeshCapabilities();
 }
 
 // ============== COORDINATOR ELECTION ==============
-void MeshSwarm::electCoordinator() {
+// painlessMesh builds a fresh std::list from its topology tree on every
+// getNodeList() call, so the list is copied once per topology change
+void MeshSwarm::refreshNodeList() {
   auto nodeList = mesh.getNodeList();
-  uint32_t lowest = myId;
+  meshNodes.assign(nodeList.begin(), nodeList.end());
+  std::sort(meshNodes.begin(), meshNodes.end());
+  peerHopsDirty = true;
+}
+
+bool MeshSwarm::isKnownNode(uint32_t nodeId) {
+  return std::binary_search(meshNodes.begin(), meshNodes.end(), nodeId);
+}
 
-  for (auto &id : nodeList) {
-    if (id < lowest) lowest = id;
+// Lowest node ID wins; only re-run when the node list changes
+void MeshSwarm::electCoordinator() {
+  uint32_t lowest = myId;
+  if (!meshNodes.empty() && meshNodes.front() < lowest) {
+    lowest = meshNodes.front();
   }
 
-  String oldRole = myRole;
   coordinatorId = lowest;
-  myRole = (lowest == myId) ? "COORD" : "PEER";
+  NodeRole role = (lowest == myId) ? ROLE_COORDINATOR : ROLE_PEER;
 
-  if (oldRole != myRole) {
-    MESH_LOG("Role: %s -> %s", oldRole.c_str(), myRole.c_str());
+  if (myRole != role) {
+    MESH_LOG("Role: %s -> %s", roleName(myRole), roleName(role));
+    myRole = role;
   }
+  updateReplicaMode();
+}
+
+const char* MeshSwarm::roleName(NodeRole role) {
+  return role == ROLE_COORDINATOR ? "COORD" : "PEER";
+}
+
+// ============== CAPABILITY NEGOTIATION ==============
+void MeshSwarm::updateMeshCapabilities() {
+  // A feature is usable mesh-wide only if every reachable node has
+  // advertised it; nodes we have not heard from yet count as legacy
+  uint8_t caps = localCapabilities();
+#if MESHSWARM_ENABLE_ADAPTIVE_HEARTBEAT
+  heartbeatAsk = false;
+#endif
+  for (uint32_t id : meshNodes) {
+    auto it = peers.find(id);
+    caps &= (it != peers.end()) ? it->second.caps : 0;
+#if MESHSWARM_ENABLE_ADAPTIVE_HEARTBEAT
+    if (it == peers.end()) heartbeatAsk = true;
+#endif
+  }
+
+  if (caps != meshCaps) {
+    MESH_LOG("Mesh capabilities: 0x%02X -> 0x%02X", meshCaps, caps);
+    meshCaps = caps;
+  }
+#if MESHSWARM_ENABLE_KEY_SCHEMA
+  updateKeySchemaShared();
+#endif
 }
 
 // ============== HEARTBEAT ==============
+// Full heartbeat: every field, missing ones read as defaults
 void MeshSwarm::sendHeartbeat() {
-  JsonDocument data;
-  data["role"] = myRole;
+  JsonDocument data(&msgArena);
+  buildHeartbeat(data);
+  data["sq"] = nextHeartbeatSeq();
+#if MESHSWARM_ENABLE_ADAPTIVE_HEARTBEAT
+  recordHeartbeat();
+#endif
+
+  const String& msg = createMsg(MSG_HEARTBEAT, data);
+  sendMsg(TX_HEARTBEAT, 0, msg);
+}
+
+void MeshSwarm::buildHeartbeat(JsonDocument& data) {
+  data["role"] = roleName(myRole);
   data["up"] = (millis() - bootTime) / 1000;
   data["heap"] = ESP.getFreeHeap();
   data["states"] = sharedState.size();
+  data["cap"] = localCapabilities();
+#if MESHSWARM_ENABLE_KEY_SCHEMA
+  if (keySchema.keys) {
+    data["ks"] = keySchema.hash;
+  }
+#endif
+  if (heartbeatInterval != HEARTBEAT_INTERVAL) {
+    data["hi"] = heartbeatInterval;
+  }
+#if MESHSWARM_ENABLE_ADAPTIVE_HEARTBEAT
+  if (heartbeatAsk) {
+    data["ask"] = 1;
+  }
+#endif
+  if (!fullReplica) {
+    JsonArray interest = data["int"].to<JsonArray>();
+    for (const String& p : interestPrefixes) {
+      interest.add(p);
+    }
+  }
+  if (stateStats.evicted > 0) {
+    data["evict"] = stateStats.evicted;
+  }
+  if (stateStats.expired > 0) {
+    data["expired"] = stateStats.expired;
+  }
 
   // Add custom heartbeat data
   for (auto& kv : heartbeatExtras) {
     data[kv.first] = kv.second;
   }
+}
+
+uint8_t MeshSwarm::localCapabilities() {
+  uint8_t caps = 0;
+#if MESHSWARM_ENABLE_BINARY_WIRE
+  if (binaryWireEnabled) caps |= CAP_BINARY_WIRE;
+#endif
+#if MESHSWARM_ENABLE_DIGEST_SYNC
+  caps |= CAP_DIGEST_SYNC | CAP_PARTIAL_SYNC;
+#endif
+  caps |= CAP_TYPED_STATE | CAP_SYNC_TARGET;
+#if MESHSWARM_ENABLE_ADAPTIVE_HEARTBEAT
+  caps |= CAP_ADAPTIVE_HEARTBEAT;
+#endif
+#if MESHSWARM_ENABLE_TELEMETRY
+  if (gatewayMode) caps |= CAP_GATEWAY;
+#endif
+  return caps;
+}
+
+// The only place alive changes, so the peer count never needs a walk
+void MeshSwarm::setPeerAlive(Peer& peer, bool alive) {
+  if (peer.alive == alive) return;
+  peer.alive = alive;
+  alivePeerCount += alive ? 1 : -1;
+}
 
-  String msg = createMsg(MSG_HEARTBEAT, data);
-  mesh.sendBroadcast(msg);
+// A peer that left the node list is dead now, not when its (possibly
+// stretched) timeout runs out; its next heartbeat revives it
+void MeshSwarm::markUnreachablePeers() {
+  for (auto& kv : peers) {
+    if (kv.second.alive && !isKnownNode(kv.first)) {
+      setPeerAlive(kv.second, false);
+    }
+  }
 }
 
+// Each peer's timeout follows the interval it announced. A peer still in
+// the node list is only marked dead: missing both beats after a reset to
+// the base interval times it out on a lossy path, and if it then skips its
+// delta beats, nothing else would bring it back before its next full beat.
 void MeshSwarm::pruneDeadPeers() {
   unsigned long now = millis();
   for (auto it = peers.begin(); it != peers.end(); ) {
-    if (now - it->second.lastSeen > 15000) {
+    if (now - it->second.lastSeen > PEER_TIMEOUT_BEATS * it->second.interval) {
+      setPeerAlive(it->second, false);
+      if (isKnownNode(it->first)) {
+        ++it;
+        continue;
+      }
       it = peers.erase(it);
     } else {
       ++it;
@@ -526,11 +1768,99 @@ void MeshSwarm::pruneDeadPeers() {
 }
 
 int MeshSwarm::getPeerCount() {
-  int count = 0;
-  for (auto &p : peers) {
-    if (p.second.alive) count++;
+  MESHSWARM_LOCK();
+  return alivePeerCount;
+}
+
+// ============== LINK QUALITY ==============
+// Never 0, so receivers can tell a sequenced heartbeat from an older one
+uint16_t MeshSwarm::nextHeartbeatSeq() {
+  if (++heartbeatSeq == 0) heartbeatSeq = 1;
+  return heartbeatSeq;
+}
+
+// Heartbeats carry a sequence number; the gap since the last one heard
+// feeds a 1/8-weight moving average of the loss rate. Beats skipped by the
+// adaptive heartbeat are not numbered, so they do not count as lost.
+void MeshSwarm::notePeerSequence(Peer& peer, uint16_t seq) {
+  if (seq == 0) return;   // Older firmware
+  uint16_t gap = seq - peer.lastSeq;
+  if (peer.lastSeq != 0 && gap != 0 && gap <= 32) {   // Larger gaps: reboot or outage
+    uint32_t sample = (gap - 1) * 1000u / gap;
+    peer.loss = (peer.loss * 7 + sample) / 8;
+  }
+  peer.lastSeq = seq;
+}
+
+// painlessMesh reports half the measured round trip
+void MeshSwarm::onNodeDelay(uint32_t nodeId, int32_t delayUs) {
+  auto it = peers.find(nodeId);
+  if (it == peers.end() || delayUs < 0) return;
+
+  Peer& p = it->second;
+  uint32_t rtt = (uint32_t)delayUs * 2;
+  p.rttUs = p.rttUs ? (p.rttUs * 7 + rtt) / 8 : rtt;
+  MESH_LOG_D("RTT %s: %u us (smoothed %u)", p.name.c_str(), rtt, p.rttUs);
+}
+
+void MeshSwarm::probeNextPeer() {
+  if (alivePeerCount == 0) return;
+  auto it = peers.upper_bound(lastProbedPeer);
+  for (size_t n = 0; n < peers.size(); n++, ++it) {
+    if (it == peers.end()) it = peers.begin();
+    if (it->second.alive && isKnownNode(it->first)) {
+      lastProbedPeer = it->first;
+      mesh.startDelayMeas(it->first);
+      return;
+    }
+  }
+}
+
+// Hops to each peer in painlessMesh's topology tree (rooted here)
+static void peerHops(const painlessmesh::protocol::NodeTree& node, int depth,
+                     std::map<uint32_t, Peer>& peers) {
+  auto it = peers.find(node.nodeId);
+  if (it != peers.end()) it->second.hops = depth > 255 ? 255 : depth;
+  for (auto& sub : node.subs) {
+    peerHops(sub, depth + 1, peers);
+  }
+}
+
+void MeshSwarm::refreshPeerHops() {
+  if (!peerHopsDirty) return;
+  for (auto& kv : peers) {
+    kv.second.hops = 0;
+  }
+  peerHops(mesh.asNodeTree(), 0, peers);
+  peerHopsDirty = false;
+}
+
+// Expected round trip (ms): measured, or LINK_HOP_RTT per hop until a probe
+// answers, stretched by the retries the loss rate implies
+uint32_t MeshSwarm::linkCost(const Peer& peer) {
+  if (peer.hops == 0) return UINT32_MAX;
+  uint32_t rtt = peer.rttUs ? peer.rttUs / 1000 : (uint32_t)peer.hops * LINK_HOP_RTT;
+  if (rtt == 0) rtt = 1;
+  uint32_t delivered = 1000 - (peer.loss < 900 ? peer.loss : 900);
+  return rtt * 1000 / delivered;
+}
+
+// Best-connected full replica that holds state and answers a request
+// addressed to it; 0 leaves the request to the coordinator
+uint32_t MeshSwarm::selectSyncResponder() {
+  refreshPeerHops();
+  uint32_t best = 0;
+  uint32_t bestCost = UINT32_MAX;
+  for (auto& kv : peers) {
+    const Peer& p = kv.second;
+    if (!p.alive || p.partial || p.states == 0 || !(p.caps & CAP_SYNC_TARGET)) continue;
+    uint32_t cost = linkCost(p);
+    if (cost < bestCost) {
+      best = p.id;
+      bestCost = cost;
+    }
   }
-  return count;
+  return best;
 }
 
 // ============== CUSTOMIZATION ==============
@@ -538,19 +1868,86 @@ int MeshSwarm::getPeerCount() {
 // setStatusLine() defined in features/MeshSwarmDisplay.inc
 
 void MeshSwarm::setHeartbeatData(const String& key, int value) {
+  MESHSWARM_LOCK();
   heartbeatExtras[key] = value;
 }
 
 // ============== HELPERS ==============
-String MeshSwarm::createMsg(MsgType type, JsonDocument& data) {
-  JsonDocument doc;
-  doc["t"] = type;
-  doc["n"] = myName;
-  doc["d"] = data;
+// ArduinoJson writer that appends to a String (serializeJson() into a
+// String replaces its content)
+struct StringAppender {
+  String& out;
+  size_t write(uint8_t c) { out.concat((char)c); return 1; }
+  size_t write(const uint8_t* s, size_t n) { out.concat((const char*)s, n); return n; }
+};
+
+static void appendJsonString(String& out, const char* s) {
+  out += '"';
+  for (; *s; s++) {
+    char c = *s;
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if ((uint8_t)c < 0x20) {
+      char esc[7];
+      snprintf(esc, sizeof(esc), "\\u%04x", (unsigned)c);
+      out += esc;
+    } else {
+      out += c;
+    }
+  }
+  out += '"';
+}
+
+// Builds the frame in txBuffer, which is reserved once in begin() and only
+// reallocated if a frame outgrows it. The result is valid until the next
+// createMsg() call.
+const String& MeshSwarm::createMsg(MsgType type, JsonDocument& data) {
+#if MESHSWARM_ENABLE_BINARY_WIRE
+  if (useBinaryFor(type) && writeBinaryMsg(type, data, txBuffer)) {
+    wireStats.binaryMsgs++;
+    wireStats.binaryBytes += txBuffer.length();
+    MESHSWARM_PERF_TX(type, txBuffer.length());
+    return txBuffer;
+  }
+  // Fall through to JSON if encoding failed
+#endif
+
+  writeJsonMsg(type, data, txBuffer);
+#if MESHSWARM_ENABLE_BINARY_WIRE
+  wireStats.jsonMsgs++;
+  wireStats.jsonBytes += txBuffer.length();
+#endif
+  MESHSWARM_PERF_TX(type, txBuffer.length());
+  return txBuffer;
+}
+
+// Queued and paced by features/MeshSwarmScheduler.inc when enabled
+#if !MESHSWARM_ENABLE_TX_SCHEDULER
+TxResult MeshSwarm::sendMsg(TxClass cls, uint32_t dest, const String& msg, const TxSentHook& onSent) {
+#if MESHSWARM_ENABLE_ADAPTIVE_HEARTBEAT
+  if (!dest) lastBroadcast = millis();
+#endif
+  if (!(dest ? mesh.sendSingle(dest, msg) : mesh.sendBroadcast(msg))) {
+    return TX_FAILED;
+  }
+  if (onSent) onSent();
+  return TX_SENT;
+}
+#endif
 
-  String out;
-  serializeJson(doc, out);
-  return out;
+// {"t":type,"n":name,"d":data} with the envelope written by hand, so the
+// payload is serialized once, straight into out
+void MeshSwarm::writeJsonMsg(MsgType type, JsonDocument& data, String& out) {
+  out = "";
+  out += "{\"t\":";
+  out += (int)type;
+  out += ",\"n\":";
+  appendJsonString(out, myName.c_str());
+  out += ",\"d\":";
+  StringAppender writer{out};
+  serializeJson(data, writer);
+  out += '}';
 }
 
 String MeshSwarm::nodeIdToName(uint32_t id) {
@@ -571,11 +1968,52 @@ String MeshSwarm::nodeIdToName(uint32_t id) {
 #include "features/MeshSwarmCallbacks.inc"
 #include "features/MeshSwarmHTTP.inc"
 #include "features/MeshSwarmTelemetry.inc"
+#include "features/MeshSwarmUplink.inc"
 #include "features/MeshSwarmOTA.inc"
+#include "features/MeshSwarmWire.inc"
+#include "features/MeshSwarmDigest.inc"
+#include "features/MeshSwarmScheduler.inc"
+#include "features/MeshSwarmSnapshot.inc"
+#include "features/MeshSwarmPerf.inc"
+#include "features/MeshSwarmThreaded.inc"
+#include "features/MeshSwarmHTTPServer.inc"
+#include "features/MeshSwarmHeartbeat.inc"
+#include "features/MeshSwarmKeySchema.inc"
+
+// ============== ADAPTIVE HEARTBEAT ==============
+// Implemented in features/MeshSwarmHeartbeat.inc when enabled; otherwise
+// every beat is a full one at HEARTBEAT_INTERVAL
+#if !MESHSWARM_ENABLE_ADAPTIVE_HEARTBEAT
+void MeshSwarm::serviceHeartbeat() {
+  sendHeartbeat();
+}
+
+void MeshSwarm::resetHeartbeat() {
+}
+#endif
+
+// ============== KEY SCHEMA ==============
+// Implemented in features/MeshSwarmKeySchema.inc when enabled; otherwise
+// every key is sent by name
+#if !MESHSWARM_ENABLE_KEY_SCHEMA
+StateType MeshSwarm::writeStateKey(JsonObject& obj, const StateEntry& entry) {
+  obj["k"] = entry.key();
+  return STATE_TYPE_STRING;
+}
+
+const char* MeshSwarm::readStateKey(JsonObject& obj, StateType* declared) {
+  *declared = STATE_TYPE_STRING;
+  return obj["k"] | "";
+}
 
-// ============== HTTP SERVER (STUB) ==============
-// Placeholder to satisfy gateway builds. Real implementation will
-// use an HTTP server (e.g., AsyncWebServer) behind a feature flag.
+void MeshSwarm::registerStateKey(StateEntry* entry) {
+}
+#endif
+
+// ============== HTTP SERVER ==============
+// Implemented in features/MeshSwarmHTTPServer.inc when enabled
+#if !MESHSWARM_ENABLE_HTTP_SERVER
 void MeshSwarm::startHTTPServer(uint16_t port) {
-  GATEWAY_LOG("HTTP server stub: requested port %u (not implemented)", port);
+  GATEWAY_LOG("HTTP server not compiled in (MESHSWARM_ENABLE_HTTP_SERVER=0), port %u unused", port);
 }
+#endif
@@ -25,6 +25,11 @@
 #include <map>
 #include <vector>
 #include <functional>
+#include "StateStore.h"
+#include "StateKeySchema.h"
+#include "MsgArena.h"
+#include "GzipEncoder.h"
+#include "RecordRing.h"
 
 // Conditional includes based on feature flags
 #if MESHSWARM_ENABLE_DISPLAY
@@ -36,6 +41,25 @@
 
 #if MESHSWARM_ENABLE_TELEMETRY || MESHSWARM_ENABLE_OTA
 #include <HTTPClient.h>
+#include <WiFiClientSecure.h>
+#endif
+
+#if MESHSWARM_ENABLE_HTTP_SERVER
+#include <ESPAsyncWebServer.h>
+#endif
+
+#if MESHSWARM_ENABLE_STATE_SNAPSHOT
+#include <Preferences.h>
+#endif
+
+#if MESHSWARM_ENABLE_TELEMETRY || MESHSWARM_ENABLE_TX_SCHEDULER
+#include <deque>
+#endif
+
+#if MESHSWARM_ENABLE_OTA && MESHSWARM_ENABLE_TELEMETRY
+#include <MD5Builder.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
 #endif
 
 // ============== DEFAULT CONFIGURATION ==============
@@ -78,6 +102,14 @@
 #ifndef I2C_SCL
 #define I2C_SCL         22
 #endif
+
+#ifndef DISPLAY_I2C_CHUNK
+#define DISPLAY_I2C_CHUNK   32      // Data bytes per I2C transaction (Wire buffer is 128 on ESP32)
+#endif
+
+// Text size 1: 6x8 pixel cells, one text line per SSD1306 page
+#define DISPLAY_LINE_CHARS  (SCREEN_WIDTH / 6)
+#define DISPLAY_PAGES       (SCREEN_HEIGHT / 8)
 #endif // MESHSWARM_ENABLE_DISPLAY
 
 // Timing
@@ -85,6 +117,38 @@
 #define HEARTBEAT_INTERVAL   5000
 #endif
 
+#ifndef PEER_TIMEOUT_BEATS
+#define PEER_TIMEOUT_BEATS   3       // A peer silent for this many of its intervals is dropped
+#endif
+
+// Link quality: hops from the topology tree, round trips from painlessMesh
+// delay probes, loss from gaps in heartbeat sequence numbers
+#ifndef LINK_PROBE_INTERVAL
+#define LINK_PROBE_INTERVAL  10000   // One peer's round trip is measured per interval (ms, 0 = off)
+#endif
+
+#ifndef LINK_HOP_RTT
+#define LINK_HOP_RTT         20      // Round trip assumed per hop until a probe answers (ms)
+#endif
+
+#ifndef LINK_COST_SLACK
+#define LINK_COST_SLACK      25      // Gateways within this % of the best link count as equally near
+#endif
+
+#if MESHSWARM_ENABLE_ADAPTIVE_HEARTBEAT
+#ifndef HEARTBEAT_INTERVAL_MAX
+#define HEARTBEAT_INTERVAL_MAX  (4 * HEARTBEAT_INTERVAL)  // Stretched interval, stable topology (ms)
+#endif
+
+#ifndef HEARTBEAT_FULL_EVERY
+#define HEARTBEAT_FULL_EVERY    6       // Every Nth beat carries all fields
+#endif
+
+#ifndef HEARTBEAT_HEAP_STEP
+#define HEARTBEAT_HEAP_STEP     1024    // Free heap is resent when it moves this much (bytes)
+#endif
+#endif // MESHSWARM_ENABLE_ADAPTIVE_HEARTBEAT
+
 #ifndef STATE_SYNC_INTERVAL
 #define STATE_SYNC_INTERVAL  10000
 #endif
@@ -93,6 +157,126 @@
 #define DISPLAY_INTERVAL     500
 #endif
 
+#ifndef STATE_FLUSH_WINDOW
+#define STATE_FLUSH_WINDOW      50     // Coalesce local writes for this long (0 = per call)
+#endif
+
+#ifndef STATE_SYNC_CHUNK_BYTES
+#define STATE_SYNC_CHUNK_BYTES  1024   // Payload budget per MSG_STATE_SYNC frame
+#endif
+
+// MSG_STATE_REQ is answered at once by the node it names ("to", the
+// requester's best-connected full replica) or, without one, by the
+// coordinator; other full replicas wait a random back-off and stand down if
+// they overhear a MSG_SYNC_CLAIM
+#ifndef STATE_REQ_BACKOFF_MIN
+#define STATE_REQ_BACKOFF_MIN   100    // ms
+#endif
+
+#ifndef STATE_REQ_BACKOFF_MAX
+#define STATE_REQ_BACKOFF_MAX   600    // ms
+#endif
+
+#ifndef WATCH_DISPATCH_BUDGET_US
+#define WATCH_DISPATCH_BUDGET_US 4000  // Deferred watcher time per update() call
+#endif
+
+// Serial console (only if serial is enabled)
+#if MESHSWARM_ENABLE_SERIAL
+#ifndef SERIAL_LINE_MAX
+#define SERIAL_LINE_MAX         128    // Longest command line; longer lines are discarded
+#endif
+
+#ifndef SERIAL_LINE_TIMEOUT
+#define SERIAL_LINE_TIMEOUT     1000   // Run a line without terminator after this idle time (ms)
+#endif
+#endif // MESHSWARM_ENABLE_SERIAL
+
+#ifndef MSG_TX_BUFFER_SIZE
+#define MSG_TX_BUFFER_SIZE      1536   // Reserved for outgoing frames (grows if exceeded)
+#endif
+
+// Digest sync configuration (only if digest sync is enabled)
+#if MESHSWARM_ENABLE_DIGEST_SYNC
+#ifndef STATE_DIGEST_BUCKETS
+#define STATE_DIGEST_BUCKETS   16      // Hash buckets per digest (same on every node)
+#endif
+
+#ifndef STATE_JOIN_SYNC_DELAY
+#define STATE_JOIN_SYNC_DELAY  1500    // Delay after a new connection before syncing
+#endif
+
+#ifndef STATE_REPAIR_BATCH
+#define STATE_REPAIR_BATCH     500     // Bucket lists this soon after a repair are answered together
+#endif
+
+#ifndef STATE_REPAIR_QUIET
+#define STATE_REPAIR_QUIET     300000  // Max time a peer with nothing to repair is left alone
+#endif
+#endif // MESHSWARM_ENABLE_DIGEST_SYNC
+
+// Outbound scheduler (rates in bytes/s; each class bucket holds one second)
+#if MESHSWARM_ENABLE_TX_SCHEDULER
+#ifndef TX_NODE_RATE
+#define TX_NODE_RATE           8192    // Airtime budget of this node, all classes
+#endif
+
+#ifndef TX_NODE_BURST
+#define TX_NODE_BURST          4096    // Bytes that may go out back to back
+#endif
+
+#ifndef TX_RATE_HEARTBEAT
+#define TX_RATE_HEARTBEAT      1024
+#endif
+
+#ifndef TX_RATE_SYNC
+#define TX_RATE_SYNC           4096
+#endif
+
+#ifndef TX_RATE_TELEMETRY
+#define TX_RATE_TELEMETRY      2048
+#endif
+
+#ifndef TX_QUEUE_BYTES
+#define TX_QUEUE_BYTES         8192    // Deferred frames held before dropping the least urgent
+#endif
+
+#ifndef TX_CONGESTION_LOAD
+#define TX_CONGESTION_LOAD     16384   // Channel load (bytes/s sent + received) that slows bulk
+#endif
+
+#ifndef TX_CONGESTED_SHARE
+#define TX_CONGESTED_SHARE     4       // Sync and telemetry refill at 1/N of their rate then
+#endif
+#endif // MESHSWARM_ENABLE_TX_SCHEDULER
+
+// Warm-boot snapshot. Peers repair anything lost since the last write, so
+// writes are spaced out for flash wear rather than kept current.
+#if MESHSWARM_ENABLE_STATE_SNAPSHOT
+#ifndef STATE_SNAPSHOT_DELAY
+#define STATE_SNAPSHOT_DELAY         5000     // Write this long after the first unsaved change (ms)
+#endif
+
+#ifndef STATE_SNAPSHOT_MIN_INTERVAL
+#define STATE_SNAPSHOT_MIN_INTERVAL  300000   // ...but at most once per this (ms)
+#endif
+
+#ifndef STATE_SNAPSHOT_MAX_BYTES
+#define STATE_SNAPSHOT_MAX_BYTES     4000     // Snapshot size; local keys are kept first
+#endif
+
+#ifndef STATE_SNAPSHOT_NAMESPACE
+#define STATE_SNAPSHOT_NAMESPACE     "meshswarm"   // NVS namespace (key "state")
+#endif
+#endif // MESHSWARM_ENABLE_STATE_SNAPSHOT
+
+// Performance instrumentation configuration (only if perf is enabled)
+#if MESHSWARM_ENABLE_PERF
+#ifndef PERF_HEAP_SAMPLE_INTERVAL
+#define PERF_HEAP_SAMPLE_INTERVAL  100   // ms between heap watermark samples
+#endif
+#endif // MESHSWARM_ENABLE_PERF
+
 // Telemetry Configuration (only if telemetry is enabled)
 #if MESHSWARM_ENABLE_TELEMETRY
 #ifndef TELEMETRY_INTERVAL
@@ -102,8 +286,87 @@
 #ifndef STATE_TELEMETRY_MIN_INTERVAL
 #define STATE_TELEMETRY_MIN_INTERVAL  2000  // Min ms between state-triggered pushes
 #endif
+
+#ifndef TELEMETRY_KEYFRAME_EVERY
+#define TELEMETRY_KEYFRAME_EVERY  10    // Delta mode: full state every N intervals
+#endif
+
+#ifndef TELEMETRY_GATEWAY_BEATS
+#define TELEMETRY_GATEWAY_BEATS    2     // Gateway heard within this many of its intervals (+1 s)
+#endif
+
+// Gateway uplink batching
+#ifndef TELEMETRY_BATCH_SIZE
+#define TELEMETRY_BATCH_SIZE     8       // Flush once this many nodes are queued
+#endif
+
+#ifndef TELEMETRY_BATCH_AGE
+#define TELEMETRY_BATCH_AGE      2000    // ...or once the oldest record is this old (ms)
+#endif
+
+#ifndef TELEMETRY_QUEUE_MAX
+#define TELEMETRY_QUEUE_MAX      32      // Queued node records before dropping oldest
+#endif
+
+#ifndef TELEMETRY_RETRY_BACKOFF
+#define TELEMETRY_RETRY_BACKOFF  5000    // Wait after a failed upload (ms)
+#endif
+
+#ifndef TELEMETRY_BATCH_POLL
+#define TELEMETRY_BATCH_POLL     250     // Worker wake-up period (ms)
+#endif
+
+// Outage backlog on the gateway (see MeshSwarmUplink.inc)
+#ifndef TELEMETRY_BACKLOG_PSRAM
+#define TELEMETRY_BACKLOG_PSRAM  (256 * 1024)  // Bytes, on boards with PSRAM
+#endif
+
+#ifndef TELEMETRY_BACKLOG_HEAP
+#define TELEMETRY_BACKLOG_HEAP   (16 * 1024)   // Bytes without PSRAM, 0 = no backlog
+#endif
+
+#ifndef TELEMETRY_BACKLOG_DRAIN_INTERVAL
+#define TELEMETRY_BACKLOG_DRAIN_INTERVAL  1000  // Min ms between backlog batches
+#endif
+
+#ifndef TELEMETRY_TASK_STACK
+#define TELEMETRY_TASK_STACK     8192
+#endif
+
+#ifndef TELEMETRY_TASK_CORE
+#define TELEMETRY_TASK_CORE      0       // WiFi core; loop() runs on core 1
+#endif
 #endif // MESHSWARM_ENABLE_TELEMETRY
 
+// HTTP helper configuration (only if telemetry or OTA is enabled)
+#if MESHSWARM_ENABLE_TELEMETRY || MESHSWARM_ENABLE_OTA
+#ifndef HTTP_GZIP_MIN_SIZE
+#define HTTP_GZIP_MIN_SIZE   512   // POST bodies below this are never compressed
+#endif
+#endif
+
+// HTTP API server configuration (only if the server is enabled)
+#if MESHSWARM_ENABLE_HTTP_SERVER
+#ifndef HTTP_SERVER_SSE_RETRY
+#define HTTP_SERVER_SSE_RETRY    3000    // Reconnect delay suggested to /api/events clients (ms)
+#endif
+#endif
+
+// Mesh task configuration (only if threaded mode is enabled)
+#if MESHSWARM_ENABLE_THREADED
+#ifndef MESH_TASK_STACK
+#define MESH_TASK_STACK          8192
+#endif
+
+#ifndef MESH_TASK_PRIORITY
+#define MESH_TASK_PRIORITY       2       // Above loop() (1)
+#endif
+
+#ifndef MESH_TASK_CORE
+#define MESH_TASK_CORE           0       // WiFi core, next to the network stack
+#endif
+#endif // MESHSWARM_ENABLE_THREADED
+
 // OTA Configuration (only if OTA is enabled)
 #if MESHSWARM_ENABLE_OTA
 #ifndef OTA_POLL_INTERVAL
@@ -111,7 +374,27 @@
 #endif
 
 #ifndef OTA_PART_SIZE
-#define OTA_PART_SIZE        1024    // Bytes per OTA chunk
+#define OTA_PART_SIZE        1024    // Default part size before adaptive selection
+#endif
+
+#ifndef OTA_PART_SIZE_MIN
+#define OTA_PART_SIZE_MIN    512     // Smallest adaptive part (deep or lossy mesh)
+#endif
+
+#ifndef OTA_PART_SIZE_MAX
+#define OTA_PART_SIZE_MAX    4096    // Largest adaptive part (gateway's direct children)
+#endif
+
+#ifndef OTA_READAHEAD_PARTS
+#define OTA_READAHEAD_PARTS  8       // Parts held in memory without a cache (two windows)
+#endif
+
+#ifndef OTA_PREFETCH_RANGE
+#define OTA_PREFETCH_RANGE   8192    // Bytes per prefetch request (multiple of 4096)
+#endif
+
+#ifndef OTA_PREFETCH_RETRIES
+#define OTA_PREFETCH_RETRIES 3       // Consecutive range failures before giving up
 #endif
 #endif // MESHSWARM_ENABLE_OTA
 
@@ -126,15 +409,54 @@ enum MsgType {
   MSG_STATE_SYNC = 3,
   MSG_STATE_REQ  = 4,
   MSG_COMMAND    = 5,
-  MSG_TELEMETRY  = 6   // Node telemetry to gateway
+  MSG_TELEMETRY  = 6,  // Node telemetry to gateway
+  MSG_STATE_DIGEST = 7, // Anti-entropy state digest
+  MSG_SYNC_CLAIM = 8   // "I am answering this node's MSG_STATE_REQ"
+};
+
+// ============== NODE CAPABILITIES ==============
+// Advertised as a bitmask in every heartbeat ("cap") so that nodes running
+// different firmware versions can agree on optional protocol features
+#define CAP_BINARY_WIRE   0x01   // Understands binary (MessagePack) frames
+#define CAP_DIGEST_SYNC   0x02   // Understands MSG_STATE_DIGEST
+#define CAP_TYPED_STATE   0x04   // Accepts native JSON numbers/bools as state values
+#define CAP_PARTIAL_SYNC  0x08   // Answers digests from partial replicas ("p")
+#define CAP_GATEWAY       0x10   // Telemetry gateway: takes MSG_TELEMETRY by sendSingle
+#define CAP_ADAPTIVE_HEARTBEAT 0x20   // Sends/understands delta heartbeats ("dt") and "hi"
+#define CAP_SYNC_TARGET   0x40   // Answers a MSG_STATE_REQ addressed to it ("to") at once
+                                 // (a role, not a protocol feature; never mesh-wide)
+
+#if MESHSWARM_ENABLE_BINARY_WIRE
+// First character of a binary frame (JSON frames always start with '{')
+#define BINARY_WIRE_MARKER  '~'
+#endif
+
+// ============== OUTBOUND PRIORITY ==============
+// Every frame is sent with a class, most urgent first
+enum TxClass {
+  TX_STATE = 0,        // State changes, sync requests and claims (never deferred)
+  TX_HEARTBEAT,        // Heartbeats
+  TX_SYNC,             // Full state syncs and digests
+  TX_TELEMETRY,        // Telemetry to the gateway
+  TX_CLASS_COUNT
+};
+
+// What sendMsg() did with a frame
+enum TxResult {
+  TX_FAILED = 0,       // painlessMesh refused it (no route)
+  TX_SENT,             // Handed to painlessMesh
+  TX_QUEUED            // Waiting for airtime; may still be dropped from a full queue
 };
 
+// Runs when a frame is handed to painlessMesh, at once or from the queue;
+// never for a frame that is dropped or refused
+typedef std::function<void()> TxSentHook;
+
 // ============== DATA STRUCTURES ==============
-struct StateEntry {
-  String value;
-  uint32_t version;
-  uint32_t origin;
-  unsigned long timestamp;
+// This node's role; sent as text ("COORD"/"PEER") in heartbeats
+enum NodeRole : uint8_t {
+  ROLE_PEER = 0,
+  ROLE_COORDINATOR = 1
 };
 
 struct Peer {
@@ -143,9 +465,194 @@ struct Peer {
   String role;
   unsigned long lastSeen;
   bool alive;
+  uint8_t caps;          // CAP_* bitmask from the peer's last heartbeat
+  uint32_t interval;     // Heartbeat interval the peer announced ("hi", ms)
+  uint16_t states;       // State entries the peer reported in its heartbeat
+  uint8_t hops;          // Distance in painlessMesh's topology tree (0 = not in it)
+  uint32_t rttUs;        // Smoothed round trip from delay probes (0 = not measured yet)
+  uint16_t loss;         // Smoothed heartbeat loss, per mille
+  uint16_t lastSeq;      // Sequence number ("sq") of the last heartbeat heard
+  uint32_t keySchema;    // Key schema hash from the peer's heartbeat ("ks", 0 = none)
+  bool partial;          // Partial replica: only stores keys matching interest
+  std::vector<String> interest;  // Key prefixes from the peer's heartbeat ("int")
+  uint32_t digestRoot;   // Root of the peer's last state digest
+  bool repairQuiet;      // Its last repair changed nothing here (see noteRepairResult())
+  uint32_t quietRoot;    // digestRoot at that repair
+  uint32_t quietOurs;    // Our root after it
+  unsigned long quietSince;  // When it went quiet
+};
+
+// State store eviction counters (also sent in heartbeats and telemetry)
+struct StateStats {
+  uint32_t expired;      // Entries dropped when their TTL passed
+  uint32_t evicted;      // Entries dropped to stay within the store limits
+  uint32_t rejected;     // Stale updates for removed keys, blocked by a tombstone
+  uint32_t filtered;     // Updates dropped by a partial replica (outside its interest)
+  uint32_t declined;     // Repaired keys not taken in because the store was full
+};
+
+#if MESHSWARM_ENABLE_STATE_SNAPSHOT
+// Warm-boot snapshot counters
+struct SnapshotStats {
+  uint32_t restored;     // Entries restored in begin()
+  uint32_t writes;       // Snapshots written to flash
+  uint32_t unchanged;    // Writes skipped because the snapshot was the same
+  uint32_t bytes;        // Size of the last snapshot
+  uint32_t omitted;      // Entries left out of the last snapshot (over STATE_SNAPSHOT_MAX_BYTES)
+};
+#endif
+
+#if MESHSWARM_ENABLE_ADAPTIVE_HEARTBEAT
+// Adaptive heartbeat counters
+struct HeartbeatStats {
+  uint32_t interval;     // Current interval (ms)
+  uint32_t full;         // Beats sent with every field
+  uint32_t delta;        // Beats sent with only the changed fields
+  uint32_t skipped;      // Beats left out because other broadcasts went out
+};
+#endif
+
+#if MESHSWARM_ENABLE_BINARY_WIRE
+// Outbound wire statistics (bytes as handed to painlessMesh)
+struct WireStats {
+  uint32_t jsonMsgs;
+  uint32_t jsonBytes;
+  uint32_t binaryMsgs;
+  uint32_t binaryBytes;
+};
+#endif
+
+#if MESHSWARM_ENABLE_TX_SCHEDULER
+// Outbound scheduler counters for one TxClass
+struct TxClassStats {
+  uint32_t sent;         // Frames handed to painlessMesh
+  uint32_t deferred;     // Frames that waited in the queue first
+  uint32_t dropped;      // Frames dropped from a full queue
+  uint32_t failed;       // Deferred frames painlessMesh refused when their turn came
+  uint16_t depth;        // Frames queued now
+  uint16_t maxDepth;
+  uint32_t maxWaitMs;    // Longest time a frame waited
+};
+
+// Outbound scheduler counters and channel load
+struct TxStats {
+  TxClassStats classes[TX_CLASS_COUNT];
+  uint32_t queuedBytes;  // Deferred frame bytes held now
+  uint32_t load;         // Channel load estimate (bytes/s sent + received)
+  bool congested;        // load above TX_CONGESTION_LOAD: sync and telemetry slowed
+};
+
+// Frame waiting for airtime
+struct TxFrame {
+  uint32_t dest;         // 0 = broadcast
+  unsigned long queuedAt;
+  String msg;
+  TxSentHook onSent;
+};
+#endif
+
+#if MESHSWARM_ENABLE_PERF
+// Timed sections of update(); nested phases are also counted in their parent
+enum PerfPhase {
+  PERF_MESH_UPDATE = 0,  // mesh.update(), includes PERF_RECEIVE
+  PERF_HEARTBEAT,        // Heartbeat send and dead peer pruning
+  PERF_STATE_FLUSH,      // Coalesced local state broadcast
+  PERF_STATE_SYNC,       // Periodic digest or full state sync
+  PERF_DISPLAY,          // Power manager and display refresh
+  PERF_TELEMETRY,        // Periodic telemetry build and send
+  PERF_SERIAL,           // Serial command handling
+  PERF_CALLBACKS,        // User loop callbacks
+  PERF_WATCHERS,         // Deferred watcher dispatch
+  PERF_RECEIVE,          // onReceive() parse and dispatch
+  PERF_LOOP,             // Whole update() call
+  PERF_PHASE_COUNT
+};
+
+#define PERF_HIST_BUCKETS  16    // Bucket i counts durations in [2^i, 2^(i+1)) us
+#define PERF_MSG_TYPES     16    // Slots indexed by MsgType (0 = unknown type)
+
+// Latency histogram for one phase
+struct PerfHistogram {
+  uint32_t count;
+  uint32_t maxUs;
+  uint64_t totalUs;
+  uint32_t buckets[PERF_HIST_BUCKETS];
+};
+
+// Per message type counters (bytes as seen by painlessMesh)
+struct PerfMsgStats {
+  uint32_t rxMsgs;
+  uint32_t rxBytes;
+  uint32_t txMsgs;       // Frames built by createMsg()
+  uint32_t txBytes;
+};
+
+// Hot-path counters since the last resetPerfStats()
+struct PerfStats {
+  PerfHistogram phases[PERF_PHASE_COUNT];
+  PerfMsgStats msgs[PERF_MSG_TYPES];
+  uint32_t jsonErrors;      // Undecodable JSON frames
+  uint32_t binaryErrors;    // Undecodable binary frames
+  uint32_t minFreeHeap;     // Lowest free heap sampled after update()
+  uint32_t minMaxAlloc;     // Lowest largest free block sampled after update()
+  unsigned long sinceMs;
+};
+#endif
+
+#if MESHSWARM_ENABLE_TELEMETRY
+// Telemetry waiting for the gateway uplink worker
+struct UplinkRecord {
+  uint32_t nodeId;
+  unsigned long queuedAt;
+  String payload;        // Serialized telemetry object
+  bool delta;            // Changed keys only: merged, never simply replaced
+  bool buffered;         // From the outage backlog (queuedAt is still when it came in)
 };
 
+// Gateway uplink counters
+struct UplinkStats {
+  uint32_t queued;       // Records handed to the queue
+  uint32_t sent;         // Records delivered to the server
+  uint32_t batches;      // Successful batch POSTs
+  uint32_t dropped;      // Records dropped because the queue was full
+  uint32_t failed;       // Failed upload attempts (records requeued)
+  uint32_t pending;      // Records currently queued
+  uint32_t buffered;     // Records moved to the outage backlog
+  uint32_t backlog;      // Records in the backlog now
+  uint32_t backlogBytes; // Backlog bytes in use
+  uint32_t backlogDropped;  // Oldest backlog records dropped to make room
+};
+#endif
+
+#if MESHSWARM_ENABLE_TELEMETRY || MESHSWARM_ENABLE_OTA
+// Pooled HTTP connection counters
+struct HttpStats {
+  uint32_t requests;     // Requests issued (including retries)
+  uint32_t connects;     // Requests that had to open a new connection
+  uint32_t retries;      // Retries after a stale kept-alive connection
+  uint32_t totalMs;      // Time spent in HTTP helpers
+  uint32_t gzipSaved;    // Request body bytes saved by gzip
+};
+#endif
+
 #if MESHSWARM_ENABLE_OTA
+// Where the gateway keeps a prefetched firmware image
+enum OTACacheType {
+  OTA_CACHE_NONE  = 0,   // No cache: parts are fetched from the server on demand
+  OTA_CACHE_PSRAM = 1,   // Whole image in PSRAM
+  OTA_CACHE_FLASH = 2    // Whole image in the spare OTA app partition
+};
+
+// Per-node OTA delivery statistics (gateway)
+struct OTANodeStats {
+  unsigned long firstMs;   // First part served
+  unsigned long lastMs;    // Latest part served
+  uint32_t bytes;          // Distinct bytes delivered
+  uint32_t parts;          // Distinct parts delivered
+  uint32_t repeats;        // Parts requested again (lost or timed out)
+  int lastPart;
+};
+
 // OTA update info from server
 struct OTAUpdateInfo {
   int updateId;
@@ -165,6 +672,21 @@ struct OTAUpdateInfo {
 // State change callback type
 typedef std::function<void(const String& key, const String& value, const String& oldValue)> StateCallback;
 
+// Registered watcher; pattern is the key, a prefix (trailing '*' removed)
+// or a glob, depending on the list it is stored in
+struct StateWatcher {
+  String pattern;
+  StateCallback callback;
+};
+
+// Change queued for deferred watcher dispatch
+struct WatchEvent {
+  uint32_t keyHash;
+  String key;
+  String value;
+  String oldValue;     // Value before the first of the coalesced changes
+};
+
 #if MESHSWARM_ENABLE_CALLBACKS
 // Custom loop callback type (for node-specific logic)
 typedef std::function<void()> LoopCallback;
@@ -172,6 +694,8 @@ typedef std::function<void()> LoopCallback;
 #if MESHSWARM_ENABLE_SERIAL
 // Custom serial command handler
 typedef std::function<bool(const String& input)> SerialHandler;
+// Serial command table entry run with the text after the command name
+typedef std::function<void(const String& args)> SerialCommandHandler;
 #endif
 
 #if MESHSWARM_ENABLE_DISPLAY
@@ -193,19 +717,50 @@ public:
   void update();
 
   // State management
-  bool setState(const String& key, const String& value);
+  // ttlMs > 0 expires the key on every node that long after the write
+  bool setState(const String& key, const String& value, uint32_t ttlMs = 0);
+  bool setState(const String& key, const char* value, uint32_t ttlMs = 0);
+  bool setState(const String& key, int value, uint32_t ttlMs = 0);
+  bool setState(const String& key, float value, uint32_t ttlMs = 0);
+  bool setState(const String& key, double value, uint32_t ttlMs = 0) { return setState(key, (float)value, ttlMs); }
+  bool setState(const String& key, bool value, uint32_t ttlMs = 0);
+  bool setStateBytes(const String& key, const uint8_t* data, size_t len, uint32_t ttlMs = 0);
   bool setStates(std::initializer_list<std::pair<String, String>> states);  // Batch update
   String getState(const String& key, const String& defaultVal = "");
-  void watchState(const String& key, StateCallback callback);
+  int32_t getStateInt(const String& key, int32_t defaultVal = 0);
+  float getStateFloat(const String& key, float defaultVal = 0);
+  bool getStateBool(const String& key, bool defaultVal = false);
+  int getStateBytes(const String& key, uint8_t* buffer, size_t maxLen);   // -1 if missing/too long
+  StateType getStateType(const String& key);                              // STATE_TYPE_STRING if missing
+  const StateStats& getStateStats() { return stateStats; }
+  uint32_t getStateVersion() { return stateVersion; }   // Changes whenever any key does
+  // pattern: a key, "prefix*", "*" for every key, or a glob with * and ?
+  void watchState(const String& pattern, StateCallback callback);
+  // Queue changes (coalesced per key) and run watchers from update()
+  // instead of inside the mesh receive path (always on in threaded mode)
+  void setDeferredWatchers(bool enable);
+
+  // Partial replication: store only keys that match a watchState() key or
+  // a subscribe() prefix (plus keys written here). The coordinator and the
+  // telemetry gateway always keep the full replica.
+  void setPartialReplica(bool enable);
+  void subscribe(const String& prefix);   // Also enables partial replication
+  bool isFullReplica() { return fullReplica; }
   void broadcastFullState();
   void requestStateSync();
+#if MESHSWARM_ENABLE_DIGEST_SYNC
+  uint32_t getStateDigest();   // Root hash over all keys/versions/origins
+#endif
 
   // Node info
   uint32_t getNodeId() { return myId; }
   String getNodeName() { return myName; }
-  String getRole() { return myRole; }
-  bool isCoordinator() { return myRole == "COORD"; }
+  String getRole() { return roleName(myRole); }
+  NodeRole getNodeRole() { return myRole; }
+  bool isCoordinator() { return myRole == ROLE_COORDINATOR; }
+  static const char* roleName(NodeRole role);
   int getPeerCount();
+  uint8_t getMeshCapabilities() { return meshCaps; }   // CAP_* bits every node advertises
 
   // Peer access
   std::map<uint32_t, Peer>& getPeers() { return peers; }
@@ -227,7 +782,10 @@ public:
   // Customization hooks
   void onLoop(LoopCallback callback);
 #if MESHSWARM_ENABLE_SERIAL
-  void onSerialCommand(SerialHandler handler);
+  void onSerialCommand(SerialHandler handler);   // Sees every line first
+  // Adds (or replaces) a command in the serial command table; usage is
+  // shown after the name in the command list
+  void addSerialCommand(const String& name, SerialCommandHandler handler, const String& usage = "");
 #endif
 #if MESHSWARM_ENABLE_DISPLAY
   void onDisplayUpdate(DisplayHandler handler);
@@ -241,6 +799,16 @@ public:
 
   // Heartbeat data customization
   void setHeartbeatData(const String& key, int value);
+#if MESHSWARM_ENABLE_ADAPTIVE_HEARTBEAT
+  HeartbeatStats getHeartbeatStats();
+#endif
+
+#if MESHSWARM_ENABLE_STATE_SNAPSHOT
+  // Warm-boot snapshot of local and subscribed keys (restored by begin())
+  bool saveStateSnapshot();        // Write now, e.g. before a planned restart
+  void clearStateSnapshot();
+  SnapshotStats getSnapshotStats();
+#endif
 
 #if MESHSWARM_ENABLE_TELEMETRY
   // Telemetry to server
@@ -250,6 +818,11 @@ public:
   bool isTelemetryEnabled() { return telemetryEnabled; }
   void pushTelemetry();
 
+  // Delta telemetry: only keys changed since the last push, with a full
+  // keyframe every TELEMETRY_KEYFRAME_EVERY intervals (the server merges)
+  void enableTelemetryDelta(bool enable);
+  bool isTelemetryDeltaEnabled() { return telemetryDelta; }
+
   // WiFi station mode for telemetry
   void connectToWiFi(const char* ssid, const char* password);
   bool isWiFiConnected();
@@ -257,10 +830,51 @@ public:
   // Gateway mode - receives telemetry from other nodes and pushes to server
   void setGatewayMode(bool enable);
   bool isGateway() { return gatewayMode; }
+  UplinkStats getUplinkStats();
 #endif // MESHSWARM_ENABLE_TELEMETRY
 
-  // HTTP API server (gateway). Currently a stub to allow builds.
-  // Future implementation will expose /api/nodes, /api/state, /api/command.
+#if MESHSWARM_ENABLE_TELEMETRY || MESHSWARM_ENABLE_OTA
+  // Pooled HTTP connection statistics (gateway)
+  HttpStats getHttpStats();
+
+  // gzip POST bodies of HTTP_GZIP_MIN_SIZE bytes or more (server must
+  // accept Content-Encoding: gzip; turned off again on a 415 reply)
+  void enableHttpCompression(bool enable);
+#endif
+
+#if MESHSWARM_ENABLE_BINARY_WIRE
+  // Binary wire format (used only when every peer supports it)
+  void enableBinaryWire(bool enable);
+  bool isBinaryWireActive() { return binaryWireEnabled && (meshCaps & CAP_BINARY_WIRE); }
+  const WireStats& getWireStats() { return wireStats; }
+#endif
+
+#if MESHSWARM_ENABLE_KEY_SCHEMA
+  // Compile-time key registry (see StateKeySchema.h); registered keys go
+  // on the wire as ids while every node runs the same schema
+  void setKeySchema(const KeySchema& schema);
+  const KeySchema& getKeySchema() { return keySchema; }
+  bool isKeySchemaActive() { return keySchemaShared; }
+#endif
+
+#if MESHSWARM_ENABLE_TX_SCHEDULER
+  // Outbound scheduler: queue depths, deferrals and channel load
+  TxStats getTxStats();
+  static const char* txClassName(TxClass cls);
+#endif
+
+#if MESHSWARM_ENABLE_PERF
+  // Hot-path instrumentation
+  const PerfStats& getPerfStats() { return perfStats; }
+  void resetPerfStats();
+  void enablePerfTelemetry(bool enable) { perfTelemetryEnabled = enable; }
+  static const char* perfPhaseName(PerfPhase phase);
+  static uint32_t perfPercentileUs(const PerfHistogram& hist, uint8_t percent);
+#endif
+
+  // HTTP API server (gateway): /api/state, /api/state/<key>, /api/nodes and
+  // the /api/events change feed. Needs MESHSWARM_ENABLE_HTTP_SERVER; call
+  // after begin(). Without the flag it only logs.
   void startHTTPServer(uint16_t port = 80);
 
 #if MESHSWARM_ENABLE_OTA
@@ -283,19 +897,74 @@ private:
 #endif
 
   // State
-  std::map<String, StateEntry> sharedState;
-  std::map<String, std::vector<StateCallback>> stateWatchers;
+  StateStore sharedState;
+  // Exact and prefix watchers are sorted by pattern for binary search;
+  // globs with a wildcard other than one trailing '*' are matched in turn
+  std::vector<StateWatcher> exactWatchers;
+  std::vector<StateWatcher> prefixWatchers;  // "" (from "*") matches every key
+  std::vector<uint16_t> prefixLengths;       // Distinct prefix lengths, ascending
+  std::vector<StateWatcher> globWatchers;
+  bool deferredWatchers;
+  std::vector<WatchEvent> watchQueue;
+  size_t watchQueueHead;                     // Next event to dispatch
   std::map<uint32_t, Peer> peers;
+  int alivePeerCount;               // Peers with alive set, kept as they change
+  uint16_t pendingStateCount;       // Entries marked pending in sharedState
+  unsigned long pendingStateSince;  // When the oldest pending write happened
+  uint32_t stateVersion;            // Bumped on every change to sharedState (HTTP ETags)
+  StateStats stateStats;
+  std::vector<String> interestPrefixes;  // watchState() keys, subscribe() prefixes; "" matches all
+  bool partialReplica;              // Requested with setPartialReplica()/subscribe()
+  bool fullReplica;                 // Effective mode (coordinator/gateway override partial)
+  std::map<uint32_t, unsigned long> pendingSyncReplies;  // Requester -> back-off deadline
+#if MESHSWARM_ENABLE_STATE_SNAPSHOT
+  SnapshotStats snapshotStats;
+  uint32_t snapshotVersion;         // stateVersion when changes were last noted
+  uint32_t snapshotHash;            // Hash of the snapshot in flash
+  bool snapshotDirty;
+  unsigned long snapshotDirtySince;
+  unsigned long lastSnapshotWrite;
+#endif
 
   // Node identity
   uint32_t myId;
   String myName;
-  String myRole;
+  NodeRole myRole;
   uint32_t coordinatorId;
+  uint8_t meshCaps;           // CAP_* bits advertised by every node in the mesh
+#if MESHSWARM_ENABLE_KEY_SCHEMA
+  KeySchema keySchema;        // keys == nullptr: no schema
+  bool keySchemaShared;       // Every node in the mesh advertises keySchema.hash
+#endif
+  std::vector<uint32_t> meshNodes;  // mesh.getNodeList(), sorted; refreshed on topology change
 
   // Timing
   unsigned long lastHeartbeat;
+  unsigned long lastPeerCheck;          // Peer timeouts, every HEARTBEAT_INTERVAL
+  unsigned long lastLinkProbe;
+  uint32_t lastProbedPeer;              // Delay probes go round the peers in ID order
+  bool peerHopsDirty;                   // Topology changed since peer hops were set
+  uint16_t heartbeatSeq;                // Sent in every heartbeat ("sq") for loss estimates
+  uint32_t heartbeatInterval;           // Current interval (ms), stretched by the adaptive heartbeat
   unsigned long lastStateSync;
+  unsigned long lastStateExpire;
+#if MESHSWARM_ENABLE_ADAPTIVE_HEARTBEAT
+  // Adaptive heartbeat: what peers last heard from us
+  HeartbeatStats heartbeatStats;
+  bool heartbeatFull;                   // Next beat carries every field
+  uint8_t heartbeatsSinceFull;
+  bool heartbeatAsk;                    // A listed node has not been heard from ("ask")
+  unsigned long lastBroadcast;          // Any broadcast also shows peers we are alive
+  uint32_t sentInterval;
+  uint32_t sentHeap;
+  uint32_t sentStates;
+  uint32_t sentEvicted;
+  uint32_t sentExpired;
+  uint32_t sentInterestHash;
+  uint8_t sentCaps;
+  NodeRole sentRole;
+  std::map<String, int> sentExtras;
+#endif
 #if MESHSWARM_ENABLE_DISPLAY
   unsigned long lastDisplayUpdate;
 #endif
@@ -312,6 +981,36 @@ private:
   unsigned long telemetryInterval;
   bool telemetryEnabled;
   bool gatewayMode;
+  uint32_t telemetryGateway;        // Gateway chosen for the last send, 0 = broadcast
+  bool telemetryDelta;
+  bool telemetryHasKeyframe;        // A keyframe was accepted, so deltas may follow
+  uint32_t telemetrySeq;            // Pushes built, sent as "seq" in delta mode
+  unsigned long telemetrySince;     // Build time of the last accepted push
+  unsigned long telemetryKeyframeAt;  // Build time of the last accepted keyframe
+
+  // Gateway uplink (queue shared with the worker task)
+  std::deque<UplinkRecord> uplinkQueue;
+  SemaphoreHandle_t uplinkMutex;
+  TaskHandle_t uplinkTask;
+  UplinkStats uplinkStats;
+  bool uplinkBatchSupported;
+  RecordRing uplinkBacklog;         // Owned by the worker task
+#endif
+
+#if MESHSWARM_LOCKING
+  // Mesh task / HTTP server; meshMutex guards everything except the display
+  // and serial I/O
+  SemaphoreHandle_t meshMutex;
+#endif
+#if MESHSWARM_ENABLE_THREADED
+  TaskHandle_t meshTask;
+#endif
+
+#if MESHSWARM_ENABLE_HTTP_SERVER
+  // HTTP API server (handlers run on the AsyncTCP task)
+  AsyncWebServer* apiServer;
+  AsyncEventSource* apiEvents;
+  uint32_t apiEpoch;                // Random per boot, so ETags never repeat across reboots
 #endif
 
 #if MESHSWARM_ENABLE_OTA
@@ -323,6 +1022,59 @@ private:
   size_t otaFirmwareSize;
   int otaLastPartSent;        // Track highest part number sent
   bool otaTransferStarted;    // True once first chunk is sent
+#if MESHSWARM_ENABLE_TELEMETRY
+  // Firmware prefetch cache (gateway)
+  OTACacheType otaCacheType;
+  const esp_partition_t* otaCachePartition;
+  uint8_t* otaPrefetchStage;  // Staging buffer for flash writes
+  size_t otaPrefetchOffset;
+  int otaPrefetchFailures;
+  bool otaPrefetching;
+  MD5Builder otaPrefetchMd5;
+  // Part delivery
+  bool otaOffered;            // Parts of the current offer are being served
+  int otaCompletedUpdate;     // Transfer finished on the mesh task, not yet reported
+  size_t otaPartSize;         // Part size chosen for the current rollout
+  uint8_t* otaReadahead;      // Uncached path: two windows of upcoming parts
+  size_t otaReadaheadHalf;    // Bytes per window
+  size_t otaReadaheadStart[2];
+  size_t otaReadaheadLen[2];  // 0 = empty or being filled
+  size_t otaReadaheadWant;    // Offset the serve callback asked for
+  int otaReadaheadFill;       // Window to fill at otaReadaheadWant, -1 = none
+  uint16_t otaRepeatPermille; // Repeat rate of the last completed node transfer
+  std::map<uint32_t, OTANodeStats> otaNodeStats;
+#endif
+#endif
+
+#if MESHSWARM_ENABLE_TELEMETRY || MESHSWARM_ENABLE_OTA
+  // Pooled HTTP connection (shared by telemetry, uplink worker and OTA)
+  HTTPClient httpClient;
+  WiFiClient httpPlainClient;
+  WiFiClientSecure* httpTlsClient;   // Allocated on first https:// request
+  String httpOrigin;                 // scheme://host[:port] of the open connection
+  bool httpSecure;
+  bool httpLastReused;
+  SemaphoreHandle_t httpMutex;
+  HttpStats httpStats;
+  GzipEncoder httpGzip;              // Guarded by httpMutex
+  bool httpCompress;
+#endif
+
+#if MESHSWARM_ENABLE_SERIAL
+  // Serial console: line accumulated without blocking, commands sorted by name
+  struct SerialCommand {
+    String name;
+    String usage;
+    void (MeshSwarm::*builtin)(const String& args);
+#if MESHSWARM_ENABLE_CALLBACKS
+    SerialCommandHandler handler;
+#endif
+  };
+  std::vector<SerialCommand> serialCommands;
+  char serialLine[SERIAL_LINE_MAX + 1];
+  uint16_t serialLineLen;
+  bool serialLineOverflow;          // Discarding until the end of an over-long line
+  unsigned long serialLastByte;
 #endif
 
 #if MESHSWARM_ENABLE_CALLBACKS
@@ -337,48 +1089,253 @@ private:
 #endif
 
 #if MESHSWARM_ENABLE_DISPLAY
-  // Display state
-  String lastStateChange;
-  String customStatus;
+  // Display state (fixed buffers, truncated to what fits on a line)
+  char lastStateChange[DISPLAY_LINE_CHARS + 1];   // "key=value"
+  char customStatus[DISPLAY_LINE_CHARS + 1];
+  bool displayDirty;              // State or status changed since the last frame
+  bool displayFlushAll;           // Panel contents unknown (boot, splash)
+  uint32_t displayUptime;         // Uptime second shown in the last frame
+  char displayLines[DISPLAY_PAGES][DISPLAY_LINE_CHARS + 1];  // Text drawn per line
+  uint32_t displayPageHash[DISPLAY_PAGES];                   // Page contents last sent
 #endif
 
   // Custom heartbeat data
   std::map<String, int> heartbeatExtras;
 
+  // Message buffers (reused by every frame built or parsed in update())
+  MsgArena msgArena;
+  String txBuffer;
+
+#if MESHSWARM_ENABLE_BINARY_WIRE
+  // Binary wire state
+  bool binaryWireEnabled;
+  WireStats wireStats;
+#endif
+
+#if MESHSWARM_ENABLE_TX_SCHEDULER
+  // Outbound scheduler (token buckets in bytes; spending may run them negative)
+  std::deque<TxFrame> txQueues[TX_CLASS_COUNT];
+  int32_t txNodeTokens;
+  int32_t txClassTokens[TX_CLASS_COUNT];
+  unsigned long txLastRefill;
+  uint32_t txWindowBytes;           // Sent + received since txWindowStart
+  unsigned long txWindowStart;
+  TxStats txStats;
+#endif
+
+#if MESHSWARM_ENABLE_DIGEST_SYNC
+  // Digest sync state (cached, rebuilt lazily after state changes)
+  uint32_t digestBuckets[STATE_DIGEST_BUCKETS];
+  bool digestValid;
+  bool repairBatch[STATE_DIGEST_BUCKETS];   // Buckets asked for since lastRepair
+  std::vector<uint32_t> repairBatchPeers;   // ...and by whom
+  unsigned long lastRepair;
+#endif
+
+#if MESHSWARM_ENABLE_PERF
+  // Perf counters
+  PerfStats perfStats;
+  bool perfTelemetryEnabled;
+  unsigned long lastPerfHeapSample;
+#endif
+
   // Internal methods
   void initMesh(const char* prefix, const char* password, uint16_t port);
 #if MESHSWARM_ENABLE_DISPLAY
   void initDisplay();
 #endif
+  void updateMesh();       // Mesh, heartbeat, flush, expiry, sync, telemetry
+  void updateLocal();      // Display, serial, watchers, loop callbacks
 
   void onReceive(uint32_t from, String &msg);
   void onNewConnection(uint32_t nodeId);
   void onDroppedConnection(uint32_t nodeId);
   void onChangedConnections();
 
+  void refreshNodeList();
+  bool isKnownNode(uint32_t nodeId);
   void electCoordinator();
   void sendHeartbeat();
+  void buildHeartbeat(JsonDocument& data);
+  void serviceHeartbeat();
+  void resetHeartbeat();
+#if MESHSWARM_ENABLE_ADAPTIVE_HEARTBEAT
+  void recordHeartbeat();
+  bool heartbeatNeedsFull();
+  bool buildHeartbeatDelta(JsonDocument& data);
+  uint32_t interestHash();
+#endif
+  uint8_t localCapabilities();
+  void updateMeshCapabilities();
+  void setPeerAlive(Peer& peer, bool alive);
+  void markUnreachablePeers();
+  uint16_t nextHeartbeatSeq();
+  void notePeerSequence(Peer& peer, uint16_t seq);
+  void onNodeDelay(uint32_t nodeId, int32_t delayUs);
+  void probeNextPeer();
+  void refreshPeerHops();
+  uint32_t linkCost(const Peer& peer);
+  uint32_t selectSyncResponder();
   void pruneDeadPeers();
 #if MESHSWARM_ENABLE_DISPLAY
   void updateDisplay();
+  bool composeDisplay();
+  bool drawDisplayLine(int line, const char* text);
+  void flushDisplayPages();
+  void noteStateChange(const char* key, const char* value);
 #endif
 #if MESHSWARM_ENABLE_SERIAL
   void processSerial();
+  void runSerialLine(const char* line);
+  void initSerialCommands();
+  SerialCommand* insertSerialCommand(const String& name, const String& usage);
+  const SerialCommand* findSerialCommand(const String& name);
+  void cmdHelp(const String& args);
+  void cmdStatus(const String& args);
+  void cmdPeers(const String& args);
+  void cmdState(const String& args);
+  void cmdSet(const String& args);
+  void cmdGet(const String& args);
+  void cmdSync(const String& args);
+  void cmdReboot(const String& args);
+#if MESHSWARM_ENABLE_DISPLAY
+  void cmdScan(const String& args);
+#endif
+#if MESHSWARM_ENABLE_TELEMETRY
+  void cmdTelem(const String& args);
+  void cmdPush(const String& args);
+#endif
+#if MESHSWARM_ENABLE_BINARY_WIRE
+  void cmdWire(const String& args);
+#endif
+#if MESHSWARM_ENABLE_TX_SCHEDULER
+  void cmdTx(const String& args);
+#endif
+#if MESHSWARM_ENABLE_PERF
+  void cmdPerf(const String& args);
+#endif
+#if MESHSWARM_ENABLE_OTA && MESHSWARM_ENABLE_TELEMETRY
+  void cmdOta(const String& args);
+#endif
 #endif
 
   void triggerWatchers(const String& key, const String& value, const String& oldValue);
-  void broadcastState(const String& key);
-  void handleStateSet(uint32_t from, JsonObject& data);
+  void runWatchers(const String& key, const String& value, const String& oldValue);
+  void dispatchWatchers();
+  bool setStateValue(const String& key, const StateValue& value, uint32_t ttlMs);
+  bool applyLocalState(const String& key, const StateValue& value, uint32_t ttlMs = 0);
+  const StateEntry* readState(const String& key);
+  void addInterest(const String& prefix);
+  bool isInterested(const char* key, size_t len);
+  const std::vector<String>* peerInterest(uint32_t nodeId);
+  void updatePeerInterest(Peer& peer, JsonArray interest);
+  void updateReplicaMode();
+  void dropUninterestedState();
+  void expireState();
+  void enforceStateBudget();
+  StateType writeStateKey(JsonObject& obj, const StateEntry& entry);
+  void writeStateValue(JsonObject& obj, const StateEntry& entry, StateType implied);
+  void writeStateTtl(JsonObject& obj, const StateEntry& entry, unsigned long now);
+  const char* readStateKey(JsonObject& obj, StateType* declared);
+  bool readStateValue(JsonObject& obj, StateValue* value, StateType declared);
+  void registerStateKey(StateEntry* entry);
+#if MESHSWARM_ENABLE_KEY_SCHEMA
+  uint8_t keySchemaId(const char* key, size_t len);
+  void updateKeySchemaShared();
+#endif
+  void broadcastState(const StateEntry& entry);
+  void handleStateSet(uint32_t from, JsonObject& data, bool repair = false);
   void handleStateSync(uint32_t from, JsonObject& data);
+  void handleStateRequest(uint32_t from, JsonObject& data);
+  void answerStateRequest(uint32_t requester);
+  void processSyncReplies(unsigned long now);
+  void sendStateEntries(uint32_t dest, const bool* bucketMask = nullptr, bool pendingOnly = false,
+                        const std::vector<String>* interest = nullptr);
+  void flushPendingState();
+#if MESHSWARM_ENABLE_STATE_SNAPSHOT
+  void restoreStateSnapshot();
+  void serviceStateSnapshot(unsigned long now);
+  size_t buildStateSnapshot(std::vector<uint8_t>& out);
+#endif
+#if MESHSWARM_ENABLE_DIGEST_SYNC
+  uint8_t stateBucket(const StateEntry& entry);
+  void refreshDigest();
+  void computeDigestBuckets(uint32_t* buckets, const std::vector<String>* interest);
+  void noteRepairResult(uint32_t from, uint32_t before);
+  void sendRepair(uint32_t dest, const bool* differs);
+  void flushRepairBatch(unsigned long now);
+  void broadcastStateDigest();
+  void sendDigestBuckets(uint32_t dest, bool reply, const std::vector<String>* interest = nullptr);
+  void handleStateDigest(uint32_t from, JsonObject& data);
+#endif
 #if MESHSWARM_ENABLE_TELEMETRY
   void handleTelemetry(uint32_t from, JsonObject& data);
   void sendTelemetryToGateway();
+  bool buildTelemetry(JsonDocument& doc, unsigned long now);
+  void noteTelemetryAccepted(unsigned long builtAt, bool keyframe);
+  uint32_t selectTelemetryGateway();
   void pushTelemetryForNode(uint32_t nodeId, JsonObject& data);
+  bool queueUplink(uint32_t nodeId, const String& payload, bool delta = false);
+  void startUplinkTask();
+  static void uplinkTaskEntry(void* arg);
+  void runUplink();
+  void postUplinkBatch(std::vector<UplinkRecord>& batch);
+  void requeueUplink(std::vector<UplinkRecord>& batch);
+  void spillUplink(std::vector<UplinkRecord>& batch);
+  bool drainUplinkBacklog();
 #endif
 
-  String createMsg(MsgType type, JsonDocument& data);
+#if MESHSWARM_LOCKING
+  friend class MeshLock;
+#endif
+#if MESHSWARM_ENABLE_THREADED
+  // Mesh task (see MESHSWARM_LOCK)
+  void startMeshTask();
+  static void meshTaskEntry(void* arg);
+  void runMeshTask();
+#endif
+
+#if MESHSWARM_ENABLE_HTTP_SERVER
+  // HTTP API handlers (run on the AsyncTCP task)
+  String apiEtag();
+  bool apiNotModified(AsyncWebServerRequest* request, const String& etag);
+  void handleApiState(AsyncWebServerRequest* request);
+  void handleApiStateKey(AsyncWebServerRequest* request, const String& key);
+  void handleApiNodes(AsyncWebServerRequest* request);
+  void publishApiEvent(const String& key, const String& value);
+#endif
+
+  const String& createMsg(MsgType type, JsonDocument& data);
+  TxResult sendMsg(TxClass cls, uint32_t dest, const String& msg,   // dest 0 = broadcast
+                   const TxSentHook& onSent = nullptr);
+#if MESHSWARM_ENABLE_TX_SCHEDULER
+  void noteAirtime(size_t bytes);
+  void refillTxTokens(unsigned long now);
+  bool txAllowed(TxClass cls);
+  TxResult transmitMsg(TxClass cls, uint32_t dest, const String& msg, const TxSentHook& onSent);
+  void deferMsg(TxClass cls, uint32_t dest, const String& msg, const TxSentHook& onSent,
+                unsigned long now);
+  void serviceTxQueues();
+#endif
+  void writeJsonMsg(MsgType type, JsonDocument& data, String& out);
   String nodeIdToName(uint32_t id);
 
+#if MESHSWARM_ENABLE_PERF
+  // Perf recording (see MESHSWARM_PERF_* macros)
+  friend class PerfScope;
+  void recordPerf(PerfPhase phase, uint32_t us);
+  void countPerfMsg(int type, size_t bytes, bool rx);
+  void samplePerfHeap();
+  void appendPerfTelemetry(JsonDocument& doc);
+#endif
+
+#if MESHSWARM_ENABLE_BINARY_WIRE
+  // Binary wire methods
+  bool useBinaryFor(MsgType type);
+  bool writeBinaryMsg(MsgType type, JsonDocument& data, String& out);
+  DeserializationError decodeBinaryMsg(const String& msg, JsonDocument& doc);
+#endif
+
 #if MESHSWARM_ENABLE_OTA
   // OTA distribution methods (gateway)
   bool pollPendingOTAUpdates();
@@ -389,14 +1346,79 @@ private:
   void reportOTAComplete(int updateId);
   void reportOTAFail(int updateId, const String& error);
   void cleanupOTABuffer();
+#if MESHSWARM_ENABLE_TELEMETRY
+  bool beginOTAPrefetch();
+  void stepOTAPrefetch();
+  bool finishOTAPrefetch();
+  size_t readOTAPart(size_t partNo, char* buffer);
+  size_t selectOTAPartSize();
+  size_t serveOTAPart(uint32_t nodeId, const String& md5, size_t partNo, char* buffer);
+  bool readOTAWindow(size_t offset, size_t len, char* buffer);
+  void fillOTAReadahead();
+  void abortOTAUpdate(const String& error);
+#endif
 #endif
 
 #if MESHSWARM_ENABLE_TELEMETRY || MESHSWARM_ENABLE_OTA
   // HTTP helpers (shared by telemetry and OTA)
+  void httpInit();
+  WiFiClient* httpConnectionFor(const String& url);
+  bool httpBegin(const String& url, int timeout);
+  void httpDrop();
+  bool httpShouldRetry(int httpCode, int attempt);
   int httpPost(const String& url, const String& payload, String* response = nullptr, int timeout = 5000);
   int httpGet(const String& url, String* response = nullptr, int timeout = 5000);
   int httpGetRange(const String& url, uint8_t* buffer, size_t bufferSize, int rangeStart, int rangeEnd, int timeout = 10000);
 #endif
 };
 
+// ============== PERF MACROS ==============
+// Compile to nothing unless MESHSWARM_ENABLE_PERF is set
+#if MESHSWARM_ENABLE_PERF
+// Times the enclosing scope into one phase histogram
+class PerfScope {
+public:
+  PerfScope(MeshSwarm* swarm, PerfPhase phase) : swarm(swarm), phase(phase), start(micros()) {}
+  ~PerfScope() { swarm->recordPerf(phase, micros() - start); }
+private:
+  MeshSwarm* swarm;
+  PerfPhase phase;
+  unsigned long start;
+};
+
+  #define MESHSWARM_PERF_SCOPE(phase)        PerfScope perfScope_##phase(this, phase)
+  #define MESHSWARM_PERF_RX(type, bytes)     countPerfMsg((type), (bytes), true)
+  #define MESHSWARM_PERF_TX(type, bytes)     countPerfMsg((type), (bytes), false)
+  #define MESHSWARM_PERF_COUNT(counter)      (perfStats.counter++)
+#else
+  #define MESHSWARM_PERF_SCOPE(phase)
+  #define MESHSWARM_PERF_RX(type, bytes)
+  #define MESHSWARM_PERF_TX(type, bytes)
+  #define MESHSWARM_PERF_COUNT(counter)
+#endif
+
+// ============== LOCK MACRO ==============
+// Compiles to nothing unless MESHSWARM_LOCKING (threaded mode or the HTTP
+// server) is set
+#if MESHSWARM_LOCKING
+// Holds meshMutex for the enclosing scope (recursive, so public calls nest)
+class MeshLock {
+public:
+  explicit MeshLock(MeshSwarm* swarm) : mutex(swarm->meshMutex) {
+    if (mutex) xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+  }
+  ~MeshLock() {
+    if (mutex) xSemaphoreGiveRecursive(mutex);
+  }
+  MeshLock(const MeshLock&) = delete;
+  MeshLock& operator=(const MeshLock&) = delete;
+private:
+  SemaphoreHandle_t mutex;
+};
+
+  #define MESHSWARM_LOCK()                   MeshLock meshLock(this)
+#else
+  #define MESHSWARM_LOCK()
+#endif
+
 #endif // MESH_SWARM_H
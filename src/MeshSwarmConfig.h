@@ -57,11 +57,127 @@
 #define MESHSWARM_ENABLE_CALLBACKS 1
 #endif
 
+// Compact binary wire format
+// Includes: MessagePack encoding for heartbeat, state and telemetry frames,
+// capability negotiation via heartbeat, wire size statistics
+// Binary frames are only sent once every known peer advertises support
+// Flash savings when disabled: ~2-3KB
+#ifndef MESHSWARM_ENABLE_BINARY_WIRE
+#define MESHSWARM_ENABLE_BINARY_WIRE 1
+#endif
+
+// Digest-based anti-entropy sync
+// Includes: Per-bucket state hashes, digest exchange, bucket-level repair
+// Periodic sync sends a small root digest instead of the full state map
+// Falls back to full-state broadcast while any legacy peer is present
+// Flash savings when disabled: ~2-3KB
+#ifndef MESHSWARM_ENABLE_DIGEST_SYNC
+#define MESHSWARM_ENABLE_DIGEST_SYNC 1
+#endif
+
+// Outbound QoS scheduler
+// Includes: Priority classes (state set > heartbeat > sync > telemetry),
+// node and per-class airtime token buckets, bulk deferral while the mesh
+// is congested, queue depth / deferral statistics, 'tx' serial command
+// State changes always go out immediately; bulk frames wait in a bounded queue
+// Flash savings when disabled: ~2KB
+#ifndef MESHSWARM_ENABLE_TX_SCHEDULER
+#define MESHSWARM_ENABLE_TX_SCHEDULER 1
+#endif
+
+// Adaptive heartbeat
+// Includes: Heartbeat interval stretched while the topology is stable,
+// delta heartbeats carrying only changed fields, beats skipped while other
+// broadcasts already show the node is alive, heartbeat counters
+// Only used while every node in the mesh advertises support
+// Flash savings when disabled: ~1KB
+#ifndef MESHSWARM_ENABLE_ADAPTIVE_HEARTBEAT
+#define MESHSWARM_ENABLE_ADAPTIVE_HEARTBEAT 1
+#endif
+
+// Warm-boot state snapshot (ESP32 NVS via Preferences)
+// Includes: Local and subscribed keys with version and origin, restored in
+// begin() before the mesh runs; written behind changes, rate limited
+// After a reboot, digest sync only repairs what changed while the node was down
+// Flash savings when disabled: ~2KB
+#ifndef MESHSWARM_ENABLE_STATE_SNAPSHOT
+#define MESHSWARM_ENABLE_STATE_SNAPSHOT 1
+#endif
+
+// Compile-time key schema (StateKeySchema.h)
+// Includes: setKeySchema(), schema hash in heartbeats ("ks"), registered
+// keys sent as small ids ("i") and declared types left off the wire
+// Only used while every node in the mesh runs the same schema
+// Flash savings when disabled: ~1KB
+#ifndef MESHSWARM_ENABLE_KEY_SCHEMA
+#define MESHSWARM_ENABLE_KEY_SCHEMA 1
+#endif
+
+// Hot-path performance instrumentation (off by default)
+// Includes: Per-phase update() latency histograms, per-message-type rx/tx
+// counters, parse failure counts, heap low watermarks, 'perf' serial command
+// Optionally appended to telemetry with enablePerfTelemetry(true)
+// Costs ~1.5KB RAM and two micros() calls per instrumented section
+#ifndef MESHSWARM_ENABLE_PERF
+#define MESHSWARM_ENABLE_PERF 0
+#endif
+
+// Dual-core execution (off by default, ESP32 only)
+// Includes: A FreeRTOS task pinned to MESH_TASK_CORE that runs mesh.update(),
+// message handling, heartbeats and sync; update() then only runs the display,
+// serial commands, loop callbacks and (always deferred) state watchers
+// Public state and peer APIs are serialized with a recursive mutex
+// Costs one task stack (MESH_TASK_STACK) and a mutex per public call
+#ifndef MESHSWARM_ENABLE_THREADED
+#define MESHSWARM_ENABLE_THREADED 0
+#endif
+
+// Async HTTP API server (off by default, gateway)
+// Includes: /api/state, /api/state/<key> and /api/nodes streamed in chunks,
+// ETag / 304 on the state version, /api/events server-sent change feed
+// Needs the ESPAsyncWebServer library (AsyncTCP comes with painlessMesh)
+// Requests run on the AsyncTCP task, so public state calls take the mesh lock
+#ifndef MESHSWARM_ENABLE_HTTP_SERVER
+#define MESHSWARM_ENABLE_HTTP_SERVER 0
+#endif
+
 // ============== FEATURE DEPENDENCY CHECKS ==============
 
 // Note: Callbacks are optional but enhance functionality when enabled with features
 // Display and Serial work without callbacks, but callbacks allow customization
 
+// The mesh lock (MESHSWARM_LOCK) is needed whenever another task reads or
+// writes mesh state: the mesh task, or the HTTP server's AsyncTCP task
+#define MESHSWARM_LOCKING (MESHSWARM_ENABLE_THREADED || MESHSWARM_ENABLE_HTTP_SERVER)
+
+// ============== STATE STORE LIMITS ==============
+// Every node replicates every key, so these bound memory mesh-wide.
+// Over a limit, keys from other nodes are evicted locally: keys with a TTL
+// first (soonest expiry first), then the least recently used. Keys written
+// by this node are never evicted. 0 disables a limit.
+
+#ifndef STATE_MAX_ENTRIES
+#define STATE_MAX_ENTRIES      256     // Keys held per node
+#endif
+
+#ifndef STATE_MAX_BYTES
+#define STATE_MAX_BYTES        24576   // Entry records + keys + value buffers
+#endif
+
+// Removed (expired or evicted) keys are remembered for a while, so a stale
+// copy from a peer's next sync does not bring them back
+#ifndef STATE_MAX_TOMBSTONES
+#define STATE_MAX_TOMBSTONES   64
+#endif
+
+#ifndef STATE_TOMBSTONE_TTL
+#define STATE_TOMBSTONE_TTL    300000  // ms
+#endif
+
+#ifndef STATE_EXPIRE_INTERVAL
+#define STATE_EXPIRE_INTERVAL  1000    // ms between TTL sweeps
+#endif
+
 // ============== LOG LEVELS ==============
 // Control verbosity of serial output to reduce flash usage
 // Set to lower level to exclude higher-verbosity messages
@@ -130,11 +246,13 @@
   #define STATE_LOG_D(fmt, ...) Serial.printf("[STATE] " fmt "\n", ##__VA_ARGS__)
   #define TELEM_LOG_D(fmt, ...) Serial.printf("[TELEM] " fmt "\n", ##__VA_ARGS__)
   #define OTA_LOG_D(fmt, ...) Serial.printf("[OTA] " fmt "\n", ##__VA_ARGS__)
+  #define GATEWAY_LOG_D(fmt, ...) Serial.printf("[GATEWAY] " fmt "\n", ##__VA_ARGS__)
 #else
   #define MESH_LOG_D(fmt, ...)
   #define STATE_LOG_D(fmt, ...)
   #define TELEM_LOG_D(fmt, ...)
   #define OTA_LOG_D(fmt, ...)
+  #define GATEWAY_LOG_D(fmt, ...)
 #endif
 
 // ============== COMPILE-TIME INFORMATION ==============
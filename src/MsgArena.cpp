@@ -0,0 +1,94 @@
+/**
+ * MsgArena - Implementation
+ */
+
+#include "MsgArena.h"
+#include <stddef.h>
+
+// Every block is preceded by its size; both stay suitably aligned
+static const size_t ARENA_ALIGN = alignof(max_align_t);
+static const size_t ARENA_HEADER = (sizeof(size_t) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+static inline size_t arenaAlign(size_t n) {
+    return (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+static inline size_t& arenaBlockSize(void* ptr) {
+    return *(size_t*)((uint8_t*)ptr - ARENA_HEADER);
+}
+
+MsgArena::MsgArena(size_t capacity)
+    : _buffer((uint8_t*)malloc(capacity)),
+      _capacity(_buffer ? capacity : 0) {
+}
+
+MsgArena::~MsgArena() {
+    free(_buffer);
+}
+
+// ============== ArduinoJson::Allocator ==============
+
+void* MsgArena::allocate(size_t size) {
+    size_t need = ARENA_HEADER + arenaAlign(size);
+    if (_used + need > _capacity) {
+        _overflows++;
+        return malloc(size);
+    }
+
+    void* ptr = _buffer + _used + ARENA_HEADER;
+    arenaBlockSize(ptr) = size;
+    _last = _used;
+    _used += need;
+    _live++;
+    if (_used > _peak) {
+        _peak = _used;
+    }
+    return ptr;
+}
+
+void MsgArena::deallocate(void* ptr) {
+    if (!owns(ptr)) {
+        free(ptr);
+        return;
+    }
+
+    if (--_live == 0) {
+        // Last message document released: recycle the whole buffer
+        _used = 0;
+        _last = SIZE_MAX;
+    } else if ((uint8_t*)ptr - ARENA_HEADER == _buffer + _last) {
+        _used = _last;
+        _last = SIZE_MAX;
+    }
+}
+
+void* MsgArena::reallocate(void* ptr, size_t newSize) {
+    if (!ptr) {
+        return allocate(newSize);
+    }
+    if (!owns(ptr)) {
+        return realloc(ptr, newSize);
+    }
+
+    size_t& size = arenaBlockSize(ptr);
+    if ((uint8_t*)ptr - ARENA_HEADER == _buffer + _last &&
+        _last + ARENA_HEADER + arenaAlign(newSize) <= _capacity) {
+        // Newest block (typically a string being built): resize in place
+        size = newSize;
+        _used = _last + ARENA_HEADER + arenaAlign(newSize);
+        if (_used > _peak) {
+            _peak = _used;
+        }
+        return ptr;
+    }
+    if (newSize <= size) {
+        return ptr;
+    }
+
+    void* moved = allocate(newSize);
+    if (moved) {
+        memcpy(moved, ptr, size);
+        deallocate(ptr);
+    }
+    return moved;
+}
@@ -0,0 +1,78 @@
+/**
+ * MsgArena - Reusable ArduinoJson allocator for MeshSwarm messages
+ *
+ * Every frame MeshSwarm builds or parses used to grow a JsonDocument on the
+ * heap and release it again a few microseconds later. MsgArena hands out
+ * memory from one buffer allocated up front instead:
+ * - allocate() bumps an offset; the most recent block can grow in place
+ * - deallocate() only counts; once every block is released the whole
+ *   buffer is recycled for the next message
+ * - Requests that do not fit fall through to malloc() and are counted
+ *
+ * Documents built with it may nest (a handler can send while the received
+ * document is still alive) as long as all of them are short-lived. Not
+ * thread safe: use it from the thread that runs MeshSwarm::update().
+ */
+
+#ifndef MSG_ARENA_H
+#define MSG_ARENA_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Build-time configuration defaults
+#ifndef MSG_ARENA_SIZE
+#define MSG_ARENA_SIZE  4096    // Bytes reserved for message documents
+#endif
+
+/**
+ * MsgArena class
+ *
+ * Usage:
+ *   MsgArena arena(MSG_ARENA_SIZE);
+ *   JsonDocument doc(&arena);
+ */
+class MsgArena : public ArduinoJson::Allocator {
+public:
+    explicit MsgArena(size_t capacity);
+    ~MsgArena();
+
+    MsgArena(const MsgArena&) = delete;
+    MsgArena& operator=(const MsgArena&) = delete;
+
+    // ============== ArduinoJson::Allocator ==============
+
+    void* allocate(size_t size) override;
+    void deallocate(void* ptr) override;
+    void* reallocate(void* ptr, size_t newSize) override;
+
+    // ============== Statistics ==============
+
+    size_t capacity() const { return _capacity; }
+    size_t used() const { return _used; }
+
+    /**
+     * Highest arena usage seen, in bytes
+     */
+    size_t peak() const { return _peak; }
+
+    /**
+     * Allocations that did not fit and went to the heap
+     */
+    uint32_t overflows() const { return _overflows; }
+
+private:
+    bool owns(const void* ptr) const {
+        return _buffer && ptr >= _buffer && ptr < _buffer + _capacity;
+    }
+
+    uint8_t* _buffer;
+    size_t _capacity;
+    size_t _used = 0;           // Bump offset
+    size_t _last = SIZE_MAX;    // Offset of the newest block, SIZE_MAX if unknown
+    size_t _live = 0;           // Arena blocks not yet released
+    size_t _peak = 0;
+    uint32_t _overflows = 0;
+};
+
+#endif // MSG_ARENA_H
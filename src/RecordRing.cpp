@@ -0,0 +1,112 @@
+/**
+ * RecordRing - Implementation
+ */
+
+#include "RecordRing.h"
+#include <string.h>
+
+// Header layout: tag (4), time (4), data length (2), little endian
+RecordRing::~RecordRing() {
+    free(_buffer);
+}
+
+bool RecordRing::begin(size_t capacity) {
+    if (_buffer) {
+        return true;
+    }
+    if (psramFound()) {
+        _buffer = (uint8_t*)ps_malloc(capacity);
+        _psram = _buffer != nullptr;
+    }
+    if (!_buffer) {
+        _buffer = (uint8_t*)malloc(capacity);
+    }
+    _capacity = _buffer ? capacity : 0;
+    return _buffer != nullptr;
+}
+
+void RecordRing::copyIn(size_t offset, const void* src, size_t len) {
+    size_t first = _capacity - offset < len ? _capacity - offset : len;
+    memcpy(_buffer + offset, src, first);
+    memcpy(_buffer, (const uint8_t*)src + first, len - first);
+}
+
+void RecordRing::copyOut(size_t offset, void* dst, size_t len) const {
+    size_t first = _capacity - offset < len ? _capacity - offset : len;
+    memcpy(dst, _buffer + offset, first);
+    memcpy((uint8_t*)dst + first, _buffer, len - first);
+}
+
+size_t RecordRing::recordSize(size_t offset) const {
+    uint8_t len[2];
+    copyOut((offset + 8) % _capacity, len, 2);
+    return HEADER_SIZE + (len[0] | (len[1] << 8));
+}
+
+bool RecordRing::push(uint32_t tag, uint32_t time, const char* data, size_t len) {
+    size_t need = HEADER_SIZE + len;
+    if (!_buffer || len > 0xFFFF || need > _capacity) {
+        return false;
+    }
+
+    while (_capacity - _used < need) {
+        pop(1);
+        _dropped++;
+    }
+
+    uint8_t header[HEADER_SIZE];
+    for (int i = 0; i < 4; i++) {
+        header[i] = (uint8_t)(tag >> (8 * i));
+        header[4 + i] = (uint8_t)(time >> (8 * i));
+    }
+    header[8] = (uint8_t)len;
+    header[9] = (uint8_t)(len >> 8);
+
+    size_t tail = (_head + _used) % _capacity;
+    copyIn(tail, header, HEADER_SIZE);
+    copyIn((tail + HEADER_SIZE) % _capacity, data, len);
+    _used += need;
+    _count++;
+    return true;
+}
+
+bool RecordRing::read(size_t& cursor, uint32_t& tag, uint32_t& time, String& data) const {
+    if (cursor >= _used) {
+        return false;
+    }
+
+    size_t offset = (_head + cursor) % _capacity;
+    uint8_t header[HEADER_SIZE];
+    copyOut(offset, header, HEADER_SIZE);
+    tag = 0;
+    time = 0;
+    for (int i = 0; i < 4; i++) {
+        tag |= (uint32_t)header[i] << (8 * i);
+        time |= (uint32_t)header[4 + i] << (8 * i);
+    }
+    size_t len = header[8] | (header[9] << 8);
+
+    // Data may wrap: append it in up to two runs
+    data = String();
+    data.reserve(len);
+    size_t start = (offset + HEADER_SIZE) % _capacity;
+    size_t first = _capacity - start < len ? _capacity - start : len;
+    data.concat((const char*)_buffer + start, first);
+    data.concat((const char*)_buffer, len - first);
+
+    cursor += HEADER_SIZE + len;
+    return true;
+}
+
+void RecordRing::pop(size_t count) {
+    while (count-- > 0 && _count > 0) {
+        size_t size = recordSize(_head);
+        _head = (_head + size) % _capacity;
+        _used -= size;
+        _count--;
+    }
+    if (_count == 0) {
+        _head = 0;
+        _used = 0;
+    }
+}
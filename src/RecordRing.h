@@ -0,0 +1,93 @@
+/**
+ * RecordRing - Bounded FIFO of variable-length records
+ *
+ * The gateway keeps telemetry it could not upload (WiFi or server down)
+ * in one of these until the link is back. Records are packed back to back
+ * in a single byte buffer, allocated once:
+ * - Each record is a 10-byte header (tag, time, length) plus its data
+ * - Records may wrap around the end of the buffer
+ * - push() drops the oldest records to make room, and counts them
+ * - The buffer comes from PSRAM when the board has it
+ *
+ * Not thread safe: use it from one task (the uplink worker).
+ */
+
+#ifndef RECORD_RING_H
+#define RECORD_RING_H
+
+#include <Arduino.h>
+
+/**
+ * RecordRing class
+ *
+ * Usage:
+ *   RecordRing ring;
+ *   ring.begin(64 * 1024);
+ *   ring.push(nodeId, millis(), json.c_str(), json.length());
+ *
+ *   size_t cursor = 0;
+ *   uint32_t tag, time;
+ *   String data;
+ *   while (ring.read(cursor, tag, time, data)) { ... }
+ *   ring.pop(count);
+ */
+class RecordRing {
+public:
+    static const size_t HEADER_SIZE = 10;
+
+    RecordRing() = default;
+    ~RecordRing();
+
+    RecordRing(const RecordRing&) = delete;
+    RecordRing& operator=(const RecordRing&) = delete;
+
+    /**
+     * Allocates the buffer (PSRAM if found, else heap). False if that
+     * failed; the ring then stays unusable.
+     */
+    bool begin(size_t capacity);
+    bool ready() const { return _buffer != nullptr; }
+
+    /**
+     * Appends a record, dropping the oldest ones until it fits. False if
+     * the record can never fit.
+     */
+    bool push(uint32_t tag, uint32_t time, const char* data, size_t len);
+
+    /**
+     * Reads the record at cursor (0 = oldest) and advances cursor to the
+     * next one. False when there are no more records.
+     */
+    bool read(size_t& cursor, uint32_t& tag, uint32_t& time, String& data) const;
+
+    /**
+     * Removes the count oldest records
+     */
+    void pop(size_t count);
+
+    bool empty() const { return _count == 0; }
+    size_t count() const { return _count; }
+    size_t used() const { return _used; }
+    size_t capacity() const { return _capacity; }
+    bool inPsram() const { return _psram; }
+
+    /**
+     * Records dropped to make room for newer ones
+     */
+    uint32_t dropped() const { return _dropped; }
+
+private:
+    void copyIn(size_t offset, const void* src, size_t len);
+    void copyOut(size_t offset, void* dst, size_t len) const;
+    size_t recordSize(size_t offset) const;
+
+    uint8_t* _buffer = nullptr;
+    size_t _capacity = 0;
+    size_t _head = 0;           // Offset of the oldest record
+    size_t _used = 0;
+    size_t _count = 0;
+    uint32_t _dropped = 0;
+    bool _psram = false;
+};
+
+#endif // RECORD_RING_H
@@ -0,0 +1,91 @@
+/**
+ * StateKeySchema - Compile-time registry of well-known state keys
+ *
+ * A sketch (or a header shared by all sketches of a deployment) lists the
+ * keys it uses with their value types. The list becomes, at compile time:
+ * - an enum of small integer ids, in list order
+ * - a constexpr table in flash, indexed by id
+ * - a hash of names and types, so nodes can tell whether they agree
+ *
+ * Once every node in the mesh advertises the same hash, registered keys
+ * go on the wire as their id ("i") instead of their name ("k"), and "vt"
+ * is left out when the value has the declared type. Receivers look the
+ * name up by index. Keys outside the schema are still sent by name.
+ *
+ * The list order is part of the wire format: append new keys at the end
+ * and deploy the same list to every node.
+ */
+
+#ifndef STATE_KEY_SCHEMA_H
+#define STATE_KEY_SCHEMA_H
+
+#include <Arduino.h>
+#include "StateStore.h"
+
+#define KEY_SCHEMA_MAX_KEYS  255    // Ids are one byte; entries store id + 1
+
+/**
+ * One registered key
+ */
+struct StateKeyDef {
+    const char* name;
+    StateType type;             // Declared type; other types still work, with "vt"
+};
+
+/**
+ * A schema: table, key count and hash (0 = no schema)
+ */
+struct KeySchema {
+    const StateKeyDef* keys;
+    uint8_t count;
+    uint32_t hash;
+};
+
+// FNV-1a over every name (with its NUL) and type, in list order.
+// Single-return constexpr functions, so this also builds as C++11.
+constexpr uint32_t keySchemaHashName(const char* s, uint32_t h) {
+    return *s ? keySchemaHashName(s + 1, (h ^ (uint8_t)*s) * 16777619u) : h * 16777619u;
+}
+
+constexpr uint32_t keySchemaHashKeys(const StateKeyDef* keys, size_t count, uint32_t h) {
+    return count == 0 ? h
+        : keySchemaHashKeys(keys + 1, count - 1,
+                            (keySchemaHashName(keys->name, h) ^ (uint8_t)keys->type) * 16777619u);
+}
+
+constexpr uint32_t keySchemaFinish(uint32_t h) {
+    return h ? h : 1;
+}
+
+constexpr uint32_t keySchemaHash(const StateKeyDef* keys, size_t count) {
+    return keySchemaFinish(keySchemaHashKeys(keys, count, 2166136261u));
+}
+
+/**
+ * Declares a schema from an X-macro list of (id, name, type)
+ *
+ * Usage:
+ *   #define APP_KEYS(X) \
+ *     X(KEY_TEMP,   "temp",   STATE_TYPE_FLOAT) \
+ *     X(KEY_LED,    "led",    STATE_TYPE_BOOL)  \
+ *     X(KEY_BUTTON, "button", STATE_TYPE_INT)
+ *   MESHSWARM_KEY_SCHEMA(AppKeys, APP_KEYS)
+ *
+ *   swarm.setKeySchema(AppKeys);
+ *   swarm.setState(AppKeys.keys[KEY_TEMP].name, 21.5f);   // or just "temp"
+ *
+ * Defines the ids (KEY_TEMP = 0, ..., AppKeys_COUNT), the table
+ * AppKeys_keys[] and the schema AppKeys.
+ */
+#define MESHSWARM_KEY_ID_(id, name, type)    id,
+#define MESHSWARM_KEY_DEF_(id, name, type)   { name, type },
+
+#define MESHSWARM_KEY_SCHEMA(schema, LIST)                                          \
+    enum : uint8_t { LIST(MESHSWARM_KEY_ID_) schema##_COUNT };                      \
+    static constexpr StateKeyDef schema##_keys[] = { LIST(MESHSWARM_KEY_DEF_) };    \
+    static_assert(schema##_COUNT <= KEY_SCHEMA_MAX_KEYS, "too many schema keys");   \
+    static constexpr KeySchema schema = {                                           \
+        schema##_keys, schema##_COUNT, keySchemaHash(schema##_keys, schema##_COUNT) \
+    };
+
+#endif // STATE_KEY_SCHEMA_H
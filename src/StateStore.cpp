@@ -0,0 +1,524 @@
+/**
+ * StateStore - Implementation
+ */
+
+#include "StateStore.h"
+#include <algorithm>
+
+// ============== Values ==============
+
+StateValue StateValue::fromString(const char* text, size_t len) {
+    StateValue v;
+    v.type = STATE_TYPE_STRING;
+    v.num.i = 0;
+    v._text = text;
+    v._len = len;
+    return v;
+}
+
+StateValue StateValue::fromInt(int32_t value) {
+    StateValue v;
+    v.type = STATE_TYPE_INT;
+    v.num.i = value;
+    v._text = nullptr;
+    v._len = snprintf(v._buf, sizeof(v._buf), "%ld", (long)value);
+    return v;
+}
+
+StateValue StateValue::fromFloat(float value) {
+    StateValue v;
+    v.type = STATE_TYPE_FLOAT;
+    v.num.f = value;
+    v._text = nullptr;
+    v._len = snprintf(v._buf, sizeof(v._buf), "%.7g", (double)value);
+    return v;
+}
+
+StateValue StateValue::fromBool(bool value) {
+    StateValue v;
+    v.type = STATE_TYPE_BOOL;
+    v.num.i = value ? 1 : 0;
+    v._text = nullptr;
+    v._buf[0] = value ? '1' : '0';
+    v._buf[1] = '\0';
+    v._len = 1;
+    return v;
+}
+
+StateValue StateValue::fromBase64(const char* text, size_t len) {
+    StateValue v = fromString(text, len);
+    v.type = STATE_TYPE_BYTES;
+    return v;
+}
+
+bool StateValue::parse(StateType type, const char* text, size_t len, StateValue* out) {
+    char* end = nullptr;
+    switch (type) {
+        case STATE_TYPE_STRING:
+            *out = fromString(text, len);
+            return true;
+        case STATE_TYPE_INT: {
+            long v = strtol(text, &end, 10);
+            if (len == 0 || end != text + len) return false;
+            *out = fromInt((int32_t)v);
+            return true;
+        }
+        case STATE_TYPE_FLOAT: {
+            float v = strtof(text, &end);
+            if (len == 0 || end != text + len) return false;
+            *out = fromFloat(v);
+            return true;
+        }
+        case STATE_TYPE_BOOL:
+            if (len == 1 && (text[0] == '1' || text[0] == '0')) {
+                *out = fromBool(text[0] == '1');
+            } else if (strcmp(text, "true") == 0 || strcmp(text, "false") == 0) {
+                *out = fromBool(text[0] == 't');
+            } else {
+                return false;
+            }
+            return true;
+        case STATE_TYPE_BYTES:
+            if (len % 4 != 0) return false;
+            *out = fromBase64(text, len);
+            return true;
+    }
+    return false;
+}
+
+bool StateEntry::valueEquals(const char* value, size_t len) const {
+    return len == _len && memcmp(this->value(), value, len) == 0;
+}
+
+bool StateEntry::equals(const StateValue& value) const {
+    if (value.type != _type) {
+        return false;
+    }
+    switch (value.type) {
+        case STATE_TYPE_INT:
+        case STATE_TYPE_BOOL:
+            return value.num.i == _num.i;
+        case STATE_TYPE_FLOAT:
+            return value.num.f == _num.f;
+        default:
+            return valueEquals(value.text(), value.length());
+    }
+}
+
+StateStore::StateStore() {
+}
+
+StateStore::~StateStore() {
+    for (StateEntry& e : _entries) {
+        if (e._cap) {
+            free(e._heap);
+        }
+    }
+    for (char* page : _pages) {
+        free(page);
+    }
+}
+
+// ============== Lookup ==============
+
+size_t StateStore::lowerBound(const char* key, size_t len) const {
+    size_t lo = 0;
+    size_t hi = _entries.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        const StateEntry& e = _entries[mid];
+        size_t n = e._keyLen < len ? e._keyLen : len;
+        int cmp = memcmp(e._key, key, n);
+        if (cmp < 0 || (cmp == 0 && e._keyLen < len)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+StateEntry* StateStore::find(const char* key, size_t len) {
+    size_t i = lowerBound(key, len);
+    if (i < _entries.size()) {
+        StateEntry& e = _entries[i];
+        if (e._keyLen == len && memcmp(e._key, key, len) == 0) {
+            return &e;
+        }
+    }
+    return nullptr;
+}
+
+const StateEntry* StateStore::after(const char* key, size_t len) const {
+    size_t i = lowerBound(key, len);
+    if (i < _entries.size()) {
+        const StateEntry& e = _entries[i];
+        if (e._keyLen == len && memcmp(e._key, key, len) == 0) {
+            i++;
+        }
+    }
+    return _entries.data() + i;
+}
+
+StateEntry* StateStore::findOrCreate(const char* key, size_t len, bool* created) {
+    *created = false;
+    size_t i = lowerBound(key, len);
+    if (i < _entries.size()) {
+        StateEntry& e = _entries[i];
+        if (e._keyLen == len && memcmp(e._key, key, len) == 0) {
+            return &e;
+        }
+    }
+
+    if (len > 0xFFFF) {
+        return nullptr;
+    }
+    const char* interned = internKey(key, len);
+    if (!interned) {
+        return nullptr;
+    }
+
+    StateEntry e;
+    memset(&e, 0, sizeof(e));
+    e._key = interned;
+    e._keyLen = (uint16_t)len;
+    _entries.insert(_entries.begin() + i, e);
+
+    *created = true;
+    return &_entries[i];
+}
+
+// Pages are never moved, which keeps entry key pointers stable across
+// vector reallocation; removed keys are reclaimed by compactKeys()
+const char* StateStore::internKey(const char* key, size_t len) {
+    size_t need = len + 1;
+    _liveKeyBytes += need;
+
+    if (need > STATE_KEY_ARENA_PAGE) {
+        // Oversized key gets its own block, kept ahead of the open page
+        char* block = (char*)malloc(need);
+        if (!block) {
+            _liveKeyBytes -= need;
+            return nullptr;
+        }
+        memcpy(block, key, len);
+        block[len] = '\0';
+        _pages.insert(_pages.empty() ? _pages.end() : _pages.end() - 1, block);
+        _arenaBytes += need;
+        return block;
+    }
+
+    if (_pageUsed + need > STATE_KEY_ARENA_PAGE) {
+        char* page = (char*)malloc(STATE_KEY_ARENA_PAGE);
+        if (!page) {
+            _liveKeyBytes -= need;
+            return nullptr;
+        }
+        _pages.push_back(page);
+        _pageUsed = 0;
+        _arenaBytes += STATE_KEY_ARENA_PAGE;
+    }
+
+    char* out = _pages.back() + _pageUsed;
+    memcpy(out, key, len);
+    out[len] = '\0';
+    _pageUsed += need;
+    return out;
+}
+
+void StateStore::releaseKey(const char* key, size_t len) {
+    size_t need = len + 1;
+    _liveKeyBytes -= need;
+
+    if (need > STATE_KEY_ARENA_PAGE) {
+        // Oversized keys own their block and are freed right away
+        for (size_t i = 0; i < _pages.size(); i++) {
+            if (_pages[i] == key) {
+                free(_pages[i]);
+                _pages.erase(_pages.begin() + i);
+                _arenaBytes -= need;
+                break;
+            }
+        }
+        return;
+    }
+
+    _deadKeyBytes += need;
+    if (_deadKeyBytes >= STATE_KEY_ARENA_PAGE && _deadKeyBytes * 2 >= _arenaBytes) {
+        compactKeys();
+    }
+}
+
+// Copies the live page keys into fresh pages and repoints their entries.
+// Oversized key blocks are kept as they are. The new pages are allocated
+// up front, so running out of memory leaves the arena untouched.
+void StateStore::compactKeys() {
+    std::vector<char*> fresh;
+    size_t used = STATE_KEY_ARENA_PAGE;
+    for (const StateEntry& e : _entries) {
+        size_t need = (size_t)e._keyLen + 1;
+        if (need > STATE_KEY_ARENA_PAGE) continue;
+        if (used + need > STATE_KEY_ARENA_PAGE) {
+            char* page = (char*)malloc(STATE_KEY_ARENA_PAGE);
+            if (!page) {
+                for (char* p : fresh) free(p);
+                return;
+            }
+            fresh.push_back(page);
+            used = 0;
+        }
+        used += need;
+    }
+
+    std::vector<char*> pages;
+    size_t arenaBytes = fresh.size() * STATE_KEY_ARENA_PAGE;
+    size_t next = 0;
+    char* out = nullptr;
+    used = STATE_KEY_ARENA_PAGE;
+    for (StateEntry& e : _entries) {
+        size_t need = (size_t)e._keyLen + 1;
+        if (need > STATE_KEY_ARENA_PAGE) {
+            pages.push_back((char*)e._key);
+            arenaBytes += need;
+            continue;
+        }
+        if (used + need > STATE_KEY_ARENA_PAGE) {
+            out = fresh[next++];
+            used = 0;
+        }
+        memcpy(out + used, e._key, need);
+        e._key = out + used;
+        used += need;
+    }
+
+    for (char* page : _pages) {
+        if (std::find(pages.begin(), pages.end(), page) == pages.end()) {
+            free(page);
+        }
+    }
+    pages.insert(pages.end(), fresh.begin(), fresh.end());
+    _pages.swap(pages);
+    _pageUsed = fresh.empty() ? STATE_KEY_ARENA_PAGE : used;
+    _arenaBytes = arenaBytes;
+    _deadKeyBytes = 0;
+}
+
+// ============== Modification ==============
+
+bool StateStore::setValue(StateEntry* entry, const StateValue& typed) {
+    const char* value = typed.text();
+    size_t len = typed.length();
+    if (len > 0xFFF0) {
+        return false;
+    }
+
+    char* dst;
+    if (entry->_cap) {
+        if (len >= entry->_cap) {
+            // Grow the existing buffer (rounded up to limit regrowth)
+            size_t cap = (len + 8) & ~(size_t)7;
+            char* grown = (char*)realloc(entry->_heap, cap);
+            if (!grown) return false;
+            _heapValueBytes += cap - entry->_cap;
+            entry->_heap = grown;
+            entry->_cap = (uint16_t)cap;
+        }
+        dst = entry->_heap;
+    } else if (len < STATE_INLINE_VALUE_SIZE) {
+        dst = entry->_inline;
+    } else {
+        size_t cap = (len + 8) & ~(size_t)7;
+        char* buf = (char*)malloc(cap);
+        if (!buf) return false;
+        _heapValueBytes += cap;
+        entry->_heap = buf;
+        entry->_cap = (uint16_t)cap;
+        dst = buf;
+    }
+
+    memmove(dst, value, len);
+    dst[len] = '\0';
+    entry->_len = (uint16_t)len;
+    entry->_type = typed.type;
+    entry->_num.i = typed.num.i;
+    return true;
+}
+
+// ============== Removal ==============
+
+void StateStore::remove(StateEntry* entry, unsigned long tombstoneExpiresAt) {
+    uint32_t hash = hashKey(entry->_key, entry->_keyLen);
+    clearTombstone(entry->_key, entry->_keyLen);
+
+    if (_maxTombstones > 0 && _tombstones.size() >= _maxTombstones) {
+        // Full: replace the tombstone closest to expiry
+        size_t oldest = 0;
+        for (size_t i = 1; i < _tombstones.size(); i++) {
+            if ((long)(_tombstones[i].expiresAt - _tombstones[oldest].expiresAt) < 0) {
+                oldest = i;
+            }
+        }
+        _tombstones.erase(_tombstones.begin() + oldest);
+    }
+    StateTombstone t;
+    t.keyHash = hash;
+    t.version = entry->version;
+    t.origin = entry->origin;
+    t.expiresAt = tombstoneExpiresAt;
+    _tombstones.push_back(t);
+
+    erase(entry);
+}
+
+void StateStore::drop(StateEntry* entry) {
+    erase(entry);
+}
+
+void StateStore::erase(StateEntry* entry) {
+    if (entry->_cap) {
+        free(entry->_heap);
+        _heapValueBytes -= entry->_cap;
+    }
+    const char* key = entry->_key;
+    size_t keyLen = entry->_keyLen;
+    _entries.erase(_entries.begin() + (entry - _entries.data()));
+    releaseKey(key, keyLen);
+}
+
+const StateTombstone* StateStore::findTombstone(const char* key, size_t len) const {
+    if (_tombstones.empty()) return nullptr;
+    uint32_t hash = hashKey(key, len);
+    for (const StateTombstone& t : _tombstones) {
+        if (t.keyHash == hash) return &t;
+    }
+    return nullptr;
+}
+
+void StateStore::clearTombstone(const char* key, size_t len) {
+    if (_tombstones.empty()) return;
+    uint32_t hash = hashKey(key, len);
+    for (size_t i = 0; i < _tombstones.size(); i++) {
+        if (_tombstones[i].keyHash == hash) {
+            _tombstones.erase(_tombstones.begin() + i);
+            return;
+        }
+    }
+}
+
+bool StateStore::pruneTombstones(unsigned long now) {
+    size_t before = _tombstones.size();
+    _tombstones.erase(std::remove_if(_tombstones.begin(), _tombstones.end(),
+                                     [now](const StateTombstone& t) {
+                                         return (long)(now - t.expiresAt) >= 0;
+                                     }),
+                      _tombstones.end());
+    return _tombstones.size() != before;
+}
+
+// ============== Limits ==============
+
+void StateStore::setLimits(size_t maxEntries, size_t maxBytes, size_t maxTombstones) {
+    _maxEntries = maxEntries;
+    _maxBytes = maxBytes;
+    _maxTombstones = maxTombstones;
+}
+
+bool StateStore::overBudget() const {
+    return (_maxEntries > 0 && _entries.size() > _maxEntries) ||
+           (_maxBytes > 0 && dataBytes() > _maxBytes);
+}
+
+// Same accounting as internKey() and setValue()
+bool StateStore::fits(size_t keyLen, size_t valueLen) const {
+    if (_maxEntries > 0 && _entries.size() >= _maxEntries) return false;
+    if (_maxBytes == 0) return true;
+
+    size_t need = sizeof(StateEntry) + keyLen + 1;
+    if (valueLen >= STATE_INLINE_VALUE_SIZE) {
+        need += (valueLen + 8) & ~(size_t)7;
+    }
+    return dataBytes() + need <= _maxBytes;
+}
+
+StateEntry* StateStore::evictionCandidate(uint32_t localOrigin) {
+    StateEntry* soonest = nullptr;
+    StateEntry* lru = nullptr;
+    for (StateEntry& e : _entries) {
+        if (e.origin == localOrigin || e.pending) continue;
+        if (e.expiresAt != 0) {
+            if (!soonest || (long)(e.expiresAt - soonest->expiresAt) < 0) {
+                soonest = &e;
+            }
+        } else if (!lru || (long)(e.lastUsed - lru->lastUsed) < 0) {
+            lru = &e;
+        }
+    }
+    return soonest ? soonest : lru;
+}
+
+// FNV-1a, shared with the digest bucket hash
+uint32_t StateStore::hashKey(const char* key, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (uint8_t)key[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// ============== Bytes Values ==============
+
+static const char STATE_B64[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+void StateStore::base64Group(const uint8_t* in, size_t len, char* out) {
+    uint32_t v = (uint32_t)in[0] << 16;
+    if (len > 1) v |= (uint32_t)in[1] << 8;
+    if (len > 2) v |= in[2];
+    out[0] = STATE_B64[(v >> 18) & 0x3F];
+    out[1] = STATE_B64[(v >> 12) & 0x3F];
+    out[2] = (len > 1) ? STATE_B64[(v >> 6) & 0x3F] : '=';
+    out[3] = (len > 2) ? STATE_B64[v & 0x3F] : '=';
+}
+
+void StateStore::base64Encode(const uint8_t* in, size_t len, char* out) {
+    for (size_t i = 0; i < len; i += 3) {
+        base64Group(in + i, len - i < 3 ? len - i : 3, out);
+        out += 4;
+    }
+    *out = '\0';
+}
+
+static int stateBase64Value(char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+int StateStore::base64Decode(const char* in, size_t len, uint8_t* out) {
+    size_t n = 0;
+    uint32_t acc = 0;
+    int bits = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (in[i] == '=') break;
+        int v = stateBase64Value(in[i]);
+        if (v < 0) return -1;
+        acc = (acc << 6) | (uint32_t)v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out[n++] = (uint8_t)(acc >> bits);
+        }
+    }
+    return (int)n;
+}
+
+// ============== Statistics ==============
+
+size_t StateStore::memoryUsage() const {
+    return _entries.capacity() * sizeof(StateEntry) + _pages.capacity() * sizeof(char*)
+         + _tombstones.capacity() * sizeof(StateTombstone) + _arenaBytes + _heapValueBytes;
+}
@@ -0,0 +1,336 @@
+/**
+ * StateStore - Compact key/value store for MeshSwarm shared state
+ *
+ * Replaces a std::map<String, StateEntry> with:
+ * - One flat vector of entries kept sorted by key (binary search lookup)
+ * - Keys copied into an arena (no per-key heap String), compacted once
+ *   enough removed keys have piled up
+ * - Small values kept inline in the entry, larger values in a heap buffer
+ *   that is reused while the new value still fits
+ *
+ * Values are typed (string, int, float, bool or bytes). Every entry keeps
+ * a canonical text form as well, so value() is always printable; numbers
+ * and bools are also held natively for typed reads and comparisons.
+ *
+ * Removed entries leave a tombstone (key hash, version, origin) so that
+ * stale copies still held by other nodes are not accepted again. Optional
+ * entry/byte limits pick eviction candidates: entries with a TTL first,
+ * soonest expiry first, then the least recently used; entries written by
+ * this node are never evicted.
+ *
+ * Entry pointers are only valid until the next findOrCreate() or remove().
+ */
+
+#ifndef STATE_STORE_H
+#define STATE_STORE_H
+
+#include <Arduino.h>
+#include <vector>
+
+// Build-time configuration defaults
+#ifndef STATE_INLINE_VALUE_SIZE
+#define STATE_INLINE_VALUE_SIZE 16      // Values shorter than this are stored inline
+#endif
+
+#ifndef STATE_KEY_ARENA_PAGE
+#define STATE_KEY_ARENA_PAGE    256     // Bytes per key arena page
+#endif
+
+#define STATE_NUMBER_TEXT_SIZE  16      // Fits any formatted int32, float or bool
+
+/**
+ * Value types (sent as "vt" on the wire, so the numbering is fixed)
+ */
+enum StateType : uint8_t {
+    STATE_TYPE_STRING = 0,
+    STATE_TYPE_INT,             // int32_t, text is decimal
+    STATE_TYPE_FLOAT,           // float, text is %.7g
+    STATE_TYPE_BOOL,            // text is "1" or "0"
+    STATE_TYPE_BYTES            // Opaque bytes, text is base64
+};
+
+/**
+ * A typed value with its canonical text form
+ *
+ * Numbers and bools are formatted into the value itself. Strings and
+ * bytes refer to caller-owned, NUL-terminated text that must outlive
+ * the StateValue.
+ */
+struct StateValue {
+    StateType type;
+    union {
+        int32_t i;              // STATE_TYPE_INT and STATE_TYPE_BOOL
+        float f;                // STATE_TYPE_FLOAT
+    } num;
+
+    static StateValue fromString(const char* text, size_t len);
+    static StateValue fromInt(int32_t value);
+    static StateValue fromFloat(float value);
+    static StateValue fromBool(bool value);
+    static StateValue fromBase64(const char* text, size_t len);
+
+    /**
+     * Parse text as the given type (typed values sent as strings)
+     * @return false if the text is not a valid value of that type
+     */
+    static bool parse(StateType type, const char* text, size_t len, StateValue* out);
+
+    const char* text() const { return _text ? _text : _buf; }
+    size_t length() const { return _len; }
+
+private:
+    const char* _text;          // nullptr: text is in _buf
+    size_t _len;
+    char _buf[STATE_NUMBER_TEXT_SIZE];
+};
+
+/**
+ * One shared state entry
+ *
+ * version/origin/timestamp/lastUsed/expiresAt are plain fields; key and value
+ * are read through accessors and the value is written through
+ * StateStore::setValue().
+ */
+struct StateEntry {
+    uint32_t version;
+    uint32_t origin;
+    unsigned long timestamp;    // Last value change
+    unsigned long lastUsed;     // Last write or read, for LRU eviction
+    unsigned long expiresAt;    // millis() deadline, 0 = no TTL
+    bool pending;               // Local change not yet broadcast (owned by MeshSwarm)
+    uint8_t keyId;              // Key schema id + 1, 0 = not registered (owned by MeshSwarm)
+
+    const char* key() const { return _key; }
+    size_t keyLength() const { return _keyLen; }
+    const char* value() const { return _cap ? _heap : _inline; }   // Canonical text
+    size_t valueLength() const { return _len; }
+    bool valueEquals(const char* value, size_t len) const;
+
+    StateType type() const { return (StateType)_type; }
+    int32_t intValue() const { return _num.i; }        // STATE_TYPE_INT / STATE_TYPE_BOOL
+    float floatValue() const { return _num.f; }        // STATE_TYPE_FLOAT
+
+    /**
+     * Same type and value; numbers compare natively, so 21.0 == 21.00
+     */
+    bool equals(const StateValue& value) const;
+
+private:
+    friend class StateStore;
+
+    const char* _key;           // Points into the key arena
+    uint8_t _type;              // StateType
+    union {
+        int32_t i;
+        float f;
+    } _num;
+    uint16_t _keyLen;
+    uint16_t _len;              // Value length
+    uint16_t _cap;              // Heap buffer capacity, 0 = inline
+    union {
+        char _inline[STATE_INLINE_VALUE_SIZE];
+        char* _heap;
+    };
+};
+
+/**
+ * Removed entry, matched by key hash (FNV-1a, see StateStore::hashKey())
+ */
+struct StateTombstone {
+    uint32_t keyHash;
+    uint32_t version;
+    uint32_t origin;
+    unsigned long expiresAt;
+
+    /**
+     * True if an update with this version/origin is not newer than the
+     * removed entry (same ordering as conflict resolution)
+     */
+    bool covers(uint32_t v, uint32_t o) const {
+        return v < version || (v == version && o >= origin);
+    }
+};
+
+/**
+ * StateStore class
+ *
+ * Usage:
+ *   bool created;
+ *   StateEntry* e = store.findOrCreate("temp", &created);
+ *   store.setValue(e, "21.5");
+ *   for (const StateEntry& e : store) { ... }
+ */
+class StateStore {
+public:
+    StateStore();
+    ~StateStore();
+
+    StateStore(const StateStore&) = delete;
+    StateStore& operator=(const StateStore&) = delete;
+
+    // ============== Lookup ==============
+
+    /**
+     * Find an entry by key
+     * @return Entry or nullptr if the key is not present
+     */
+    StateEntry* find(const char* key, size_t len);
+    StateEntry* find(const String& key) { return find(key.c_str(), key.length()); }
+
+    /**
+     * First entry whose key sorts after key (resumes an iteration that
+     * released its lock, even if entries were added or removed meanwhile)
+     * @return Entry or end()
+     */
+    const StateEntry* after(const char* key, size_t len) const;
+
+    /**
+     * Find an entry, inserting an empty one (version 0) if missing
+     * Uses a single binary search for both cases.
+     * @param created Set to true if the entry was inserted
+     * @return Entry or nullptr if the key could not be stored
+     */
+    StateEntry* findOrCreate(const char* key, size_t len, bool* created);
+    StateEntry* findOrCreate(const String& key, bool* created) {
+        return findOrCreate(key.c_str(), key.length(), created);
+    }
+
+    // ============== Modification ==============
+
+    /**
+     * Replace an entry's value (and type)
+     * @return false if the value is too long or memory is exhausted
+     */
+    bool setValue(StateEntry* entry, const StateValue& value);
+    bool setValue(StateEntry* entry, const char* value, size_t len) {
+        return setValue(entry, StateValue::fromString(value, len));
+    }
+    bool setValue(StateEntry* entry, const String& value) {
+        return setValue(entry, value.c_str(), value.length());
+    }
+
+    // ============== Removal ==============
+
+    /**
+     * Remove an entry and leave a tombstone until tombstoneExpiresAt
+     * Invalidates entry pointers.
+     */
+    void remove(StateEntry* entry, unsigned long tombstoneExpiresAt);
+
+    /**
+     * Remove an entry without a tombstone: the key was not removed
+     * mesh-wide, so a later update for it must still be accepted.
+     * Invalidates entry pointers.
+     */
+    void drop(StateEntry* entry);
+
+    /**
+     * Tombstone for a key
+     * @return Tombstone or nullptr if the key was not removed recently
+     */
+    const StateTombstone* findTombstone(const char* key, size_t len) const;
+    void clearTombstone(const char* key, size_t len);
+
+    /**
+     * Drop tombstones whose deadline has passed
+     * @return true if any were dropped
+     */
+    bool pruneTombstones(unsigned long now);
+
+    const std::vector<StateTombstone>& tombstones() const { return _tombstones; }
+
+    // ============== Limits ==============
+
+    /**
+     * Entry, byte and tombstone limits (0 = unlimited)
+     * dataBytes() is what maxBytes is measured against.
+     */
+    void setLimits(size_t maxEntries, size_t maxBytes, size_t maxTombstones);
+    bool overBudget() const;
+
+    /**
+     * Whether a new entry with this key and value length fits within the
+     * limits without evicting anything
+     */
+    bool fits(size_t keyLen, size_t valueLen) const;
+
+    /**
+     * Next entry to evict when over budget: an entry with a TTL (soonest
+     * expiry first), otherwise the least recently used. Entries from
+     * localOrigin and entries flagged pending are never picked.
+     * @return Entry or nullptr if nothing can be evicted
+     */
+    StateEntry* evictionCandidate(uint32_t localOrigin);
+
+    /**
+     * Hash used for tombstones and digest buckets
+     */
+    static uint32_t hashKey(const char* key, size_t len);
+
+    // ============== Iteration ==============
+
+    StateEntry* begin() { return _entries.data(); }
+    StateEntry* end() { return _entries.data() + _entries.size(); }
+    const StateEntry* begin() const { return _entries.data(); }
+    const StateEntry* end() const { return _entries.data() + _entries.size(); }
+
+    size_t size() const { return _entries.size(); }
+    bool empty() const { return _entries.empty(); }
+
+    /**
+     * Approximate heap used by entries, key arena and value buffers
+     */
+    size_t memoryUsage() const;
+
+    /**
+     * Bytes held by live entries: entry records, keys and value buffers
+     */
+    size_t dataBytes() const {
+        return _entries.size() * sizeof(StateEntry) + _liveKeyBytes + _heapValueBytes;
+    }
+
+    // ============== Bytes Values ==============
+
+    /**
+     * Base64 text length for len bytes (excluding the NUL)
+     */
+    static size_t base64Length(size_t len) { return ((len + 2) / 3) * 4; }
+
+    /**
+     * Base64-encode into out (base64Length(len) + 1 bytes, NUL-terminated)
+     */
+    static void base64Encode(const uint8_t* in, size_t len, char* out);
+
+    /**
+     * Base64-encode one group of 1 to 3 bytes into 4 characters, padded
+     * with '=' (not NUL-terminated); for encoders that see bytes one by one
+     */
+    static void base64Group(const uint8_t* in, size_t len, char* out);
+
+    /**
+     * Decode base64 into out (capacity >= len * 3 / 4)
+     * @return Bytes written, or -1 on invalid input
+     */
+    static int base64Decode(const char* in, size_t len, uint8_t* out);
+
+private:
+    size_t lowerBound(const char* key, size_t len) const;
+    void erase(StateEntry* entry);
+    const char* internKey(const char* key, size_t len);
+    void releaseKey(const char* key, size_t len);
+    void compactKeys();
+
+    std::vector<StateEntry> _entries;   // Sorted by key
+    std::vector<char*> _pages;          // Key arena, last page is the open one
+    std::vector<StateTombstone> _tombstones;
+    size_t _pageUsed = STATE_KEY_ARENA_PAGE;
+    size_t _arenaBytes = 0;
+    size_t _liveKeyBytes = 0;
+    size_t _deadKeyBytes = 0;           // Removed keys still occupying arena pages
+    size_t _heapValueBytes = 0;
+    size_t _maxEntries = 0;
+    size_t _maxBytes = 0;
+    size_t _maxTombstones = 0;
+};
+
+#endif // STATE_STORE_H